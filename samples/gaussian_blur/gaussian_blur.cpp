@@ -31,6 +31,9 @@
 #include <CL/sycl.hpp>
 
 #include <iostream>
+#include <vector>
+
+#include "autotuner.hpp"
 
 /* These public-domain headers implement useful image reading and writing
  * functions. */
@@ -44,32 +47,75 @@ using namespace cl::sycl;
 using co = cl::sycl::image_format::channel_order;
 using ct = cl::sycl::image_format::channel_type;
 
-/* Attempts to determine a good local size. The OpenCL implementation can
- * do the same, but the best way to *control* performance is to choose the
- * sizes. The method here is to choose the largest number, leq 64, which is
- * a power-of-two, and divides the global work size evenly. In this code,
- * it might prove most optimal to pad the image along one dimension so that
- * the local size could be 64, but this introduces other complexities. */
-range<2> get_optimal_local_range(cl::sycl::range<2> globalSize,
-                                 cl::sycl::device d) {
-  range<2> optimalLocalSize;
-  /* 64 is a good local size on GPU-like devices, as each compute unit is
-   * made of many smaller processors. On non-GPU devices, 4 is a common vector
-   * width. */
-  if (d.is_gpu()) {
-    optimalLocalSize = range<2>(64, 1);
-  } else {
-    optimalLocalSize = range<2>(4, 1);
-  }
-  /* Here, for each dimension, we make sure that it divides the global size
-   * evenly. If it doesn't, we try the next lowest power of two. Eventually
-   * it will reach one, if the global size has no power of two component. */
-  for (int i = 0; i < 2; ++i) {
-    while (globalSize[i] % optimalLocalSize[i]) {
-      optimalLocalSize[i] = optimalLocalSize[i] >> 1;
+/* Blurs image_in into image_out with work-groups of localRange. */
+void blur(queue &myQueue, image<2> &image_in, image<2> &image_out,
+          range<2> imgRange, range<2> localRange) {
+  myQueue.submit([&](handler &cgh) {
+    /* The nd_range contains the total work (as mentioned previously) as
+     * well as the local work size (i.e. the number of threads in the local
+     * group). */
+    auto myRange = nd_range<2>(imgRange, localRange);
+    /* Images still require accessors, like buffers, except the target is
+     * always access::target::image. */
+    accessor<float4, 2, access::mode::read, access::target::image> inPtr(
+        image_in, cgh);
+    accessor<float4, 2, access::mode::write, access::target::image> outPtr(
+        image_out, cgh);
+    /* The sampler is used to map user-provided co-ordinates to pixels in
+     * the image. */
+    sampler smpl(false, sampler_addressing_mode::clamp,
+                 sampler_filter_mode::nearest);
+
+    cgh.parallel_for<class GaussianKernel>(myRange, ([=](nd_item<2> itemID) {
+      const int blendMask = 10;
+      float4 newPixel = float4(0.0f, 0.0f, 0.0f, 0.0f);
+
+      for (int x = -(blendMask / 2); x < (blendMask / 2); x++) {
+        for (int y = -(blendMask / 2); y < (blendMask / 2); y++) {
+          auto inputCoords =
+              int2(itemID.get_global(0) + x, itemID.get_global(1) + y);
+          newPixel += inPtr(smpl)[inputCoords];
+        }
+      }
+
+      newPixel /= (float)(blendMask * blendMask);
+
+      auto outputCoords = int2(itemID.get_global(0), itemID.get_global(1));
+      outPtr[outputCoords] = newPixel;
+    }));
+  });
+}
+
+/* Determines a good local size. The OpenCL implementation can do the
+ * same, but the best way to *control* performance is to choose the sizes.
+ * The best size depends on the device and on the kernel, so rather than
+ * guessing it, the method here is to time run, which blurs the image, with
+ * every local size made of powers of two that divide the global work size
+ * evenly and fit in a work-group of the device, and to keep the fastest.
+ * The autotuner stores the choice in its cache, so it is only timed the
+ * first time the sample runs on a device with an image of a similar size.
+ * In this code, it might prove most optimal to pad the image so that more
+ * local sizes divide it, but this introduces other complexities. */
+template <typename RunT>
+range<2> get_optimal_local_range(codeplay::autotuner &tuner,
+                                 cl::sycl::range<2> globalSize,
+                                 cl::sycl::device d, RunT run) {
+  auto maxSize = d.get_info<cl::sycl::info::device::max_work_group_size>();
+  std::vector<codeplay::tuning_params> candidates;
+  for (size_t x = 1; x <= maxSize && globalSize[0] % x == 0; x *= 2) {
+    for (size_t y = 1; x * y <= maxSize && globalSize[1] % y == 0; y *= 2) {
+      candidates.push_back({int(x), int(y)});
     }
   }
-  return optimalLocalSize;
+  auto result = tuner.tune(d, "gaussian_blur", globalSize.size(), candidates,
+                           [&](const codeplay::tuning_params &p) {
+                             run(range<2>(p[0], p[1]));
+                           });
+  std::cout << "Local range " << result.params[0] << " x "
+            << result.params[1]
+            << (result.cached ? ", tuned by a previous run" : ", tuned")
+            << " (" << tuner.path() << ")" << std::endl;
+  return range<2>(result.params[0], result.params[1]);
 }
 
 int main(int argc, char *argv[]) {
@@ -106,7 +152,9 @@ int main(int argc, char *argv[]) {
   /* This range represents the full amount of work to be done across the
    * image. We dispatch one thread per pixel. */
   range<2> imgRange(inputWidth, inputHeight);
-  queue myQueue;
+  /* The queue rethrows the asynchronous errors, so that the tuner skips the
+   * local ranges with which the blur fails. */
+  queue myQueue(codeplay::rethrow_async_errors);
   {
     /* Images need a void * pointing to the data, and enums describing the
      * type of the image (since a void * carries no type information). It
@@ -114,42 +162,16 @@ int main(int argc, char *argv[]) {
     image<2> image_in(inputData, co::RGBA, ct::UNORM_INT8, imgRange);
     image<2> image_out(outputData, co::RGBA, ct::UNORM_INT8, imgRange);
 
-    myQueue.submit([&](handler &cgh) {
-      /* The nd_range contains the total work (as mentioned previously) as
-       * well as the local work size (i.e. the number of threads in the local
-       * group). Here, we attempt to find a range close to the device's
-       * preferred size that also divides the global size neatly. */
-      auto r = get_optimal_local_range(imgRange, myQueue.get_device());
-      auto myRange = nd_range<2>(imgRange, r);
-      /* Images still require accessors, like buffers, except the target is
-       * always access::target::image. */
-      accessor<float4, 2, access::mode::read, access::target::image> inPtr(
-          image_in, cgh);
-      accessor<float4, 2, access::mode::write, access::target::image> outPtr(
-          image_out, cgh);
-      /* The sampler is used to map user-provided co-ordinates to pixels in
-       * the image. */
-      sampler smpl(false, sampler_addressing_mode::clamp,
-                   sampler_filter_mode::nearest);
-
-      cgh.parallel_for<class GaussianKernel>(myRange, ([=](nd_item<2> itemID) {
-        const int blendMask = 10;
-        float4 newPixel = float4(0.0f, 0.0f, 0.0f, 0.0f);
-
-        for (int x = -(blendMask / 2); x < (blendMask / 2); x++) {
-          for (int y = -(blendMask / 2); y < (blendMask / 2); y++) {
-            auto inputCoords =
-                int2(itemID.get_global(0) + x, itemID.get_global(1) + y);
-            newPixel += inPtr(smpl)[inputCoords];
-          }
-        }
-
-        newPixel /= (float)(blendMask * blendMask);
-
-        auto outputCoords = int2(itemID.get_global(0), itemID.get_global(1));
-        outPtr[outputCoords] = newPixel;
-      }));
-    });
+    /* Here, we time the blur with the local sizes that divide the global
+     * size neatly, unless a previous run has already found the best one. */
+    codeplay::autotuner tuner;
+    auto r = get_optimal_local_range(tuner, imgRange, myQueue.get_device(),
+                                     [&](range<2> localRange) {
+                                       blur(myQueue, image_in, image_out,
+                                            imgRange, localRange);
+                                       myQueue.wait_and_throw();
+                                     });
+    blur(myQueue, image_in, image_out, imgRange, r);
   }
 
   /* Attempt to change the name from x.png or x.jpg to x-blurred.png and so
@@ -0,0 +1,262 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  batched_gemm.cpp
+ *
+ *  Description:
+ *    Sample code that multiplies a batch of small matrices with one kernel,
+ *    and compares it with a buffer and a kernel per multiplication.
+ *
+ **************************************************************************/
+
+#include <CL/sycl.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "host_gemm.hpp"
+#include "sycl_gemm.hpp"
+
+using namespace cl::sycl;
+
+using seconds_t = std::chrono::duration<double>;
+
+/* Random matrices of a batch: count problems of the shape s, with the
+ * matrices of problem p at p * sizeA, p * sizeB and p * sizeC. */
+struct batch_data {
+  gemm_shape s;
+  int count;
+  int sizeA;
+  int sizeB;
+  int sizeC;
+  std::vector<float> A;
+  std::vector<float> B;
+  std::vector<float> C;
+};
+
+batch_data make_batch(const gemm_shape& s, int count, std::mt19937& rng) {
+  batch_data d;
+  d.s = s;
+  d.count = count;
+  d.sizeA = (s.transA ? s.k : s.m) * s.lda;
+  d.sizeB = (s.transB ? s.n : s.k) * s.ldb;
+  d.sizeC = s.m * s.ldc;
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  d.A.resize(std::size_t(count) * d.sizeA);
+  d.B.resize(std::size_t(count) * d.sizeB);
+  d.C.resize(std::size_t(count) * d.sizeC);
+  for (auto& x : d.A) {
+    x = dist(rng);
+  }
+  for (auto& x : d.B) {
+    x = dist(rng);
+  }
+  for (auto& x : d.C) {
+    x = dist(rng);
+  }
+  return d;
+}
+
+/* Computes the expected C of the batch on the host */
+std::vector<float> expected_c(const batch_data& d, float alpha, float beta) {
+  const gemm_shape& s = d.s;
+  std::vector<float> C(d.C);
+  for (int p = 0; p < d.count; p++) {
+    host_gemm(s.transA, s.transB, s.m, s.n, s.k, alpha,
+              d.A.data() + p * d.sizeA, s.lda,
+              d.B.data() + p * d.sizeB, s.ldb, beta,
+              C.data() + p * d.sizeC, s.ldc);
+  }
+  return C;
+}
+
+/* Returns true if the two batches of results differ */
+bool compare(const std::string& name, const std::vector<float>& C,
+             const std::vector<float>& expected) {
+  for (std::size_t i = 0; i < C.size(); i++) {
+    float diff = std::fabs(C[i] - expected[i]);
+    if (diff > 1e-3f * std::fabs(expected[i]) + 1e-3f) {
+      std::cout << " " << name << ": element " << i << " differs: " << C[i]
+                << " != " << expected[i] << std::endl;
+      return true;
+    }
+  }
+  return false;
+}
+
+/* Multiplies a batch of problems of the given shape with the strided and
+ * the offset array versions of batched_gemm. The offset arrays give the
+ * problems in reverse order.
+ * Returns true if there is an error. */
+bool check_batch(queue& q, const gemm_shape& s, int count, std::mt19937& rng) {
+  batch_data d = make_batch(s, count, rng);
+  const float alpha = 2.0f;
+  const float beta = 0.5f;
+  std::vector<float> expected = expected_c(d, alpha, beta);
+  bool error = false;
+
+  std::vector<float> C(d.C);
+  {
+    buffer<float, 1> bA(d.A.data(), range<1>(d.A.size()));
+    buffer<float, 1> bB(d.B.data(), range<1>(d.B.size()));
+    buffer<float, 1> bC(C.data(), range<1>(C.size()));
+    batched_gemm(q, s, count, alpha, bA, d.sizeA, bB, d.sizeB, beta, bC,
+                 d.sizeC);
+  }
+  error = compare("strided", C, expected) || error;
+
+  C = d.C;
+  {
+    std::vector<int> offA(count), offB(count), offC(count);
+    for (int p = 0; p < count; p++) {
+      offA[p] = (count - 1 - p) * d.sizeA;
+      offB[p] = (count - 1 - p) * d.sizeB;
+      offC[p] = (count - 1 - p) * d.sizeC;
+    }
+    buffer<float, 1> bA(d.A.data(), range<1>(d.A.size()));
+    buffer<float, 1> bB(d.B.data(), range<1>(d.B.size()));
+    buffer<float, 1> bC(C.data(), range<1>(C.size()));
+    buffer<int, 1> bOffA(offA.data(), range<1>(count));
+    buffer<int, 1> bOffB(offB.data(), range<1>(count));
+    buffer<int, 1> bOffC(offC.data(), range<1>(count));
+    batched_gemm(q, s, count, alpha, bA, bOffA, bB, bOffB, beta, bC, bOffC);
+  }
+  error = compare("offset arrays", C, expected) || error;
+
+  if (error) {
+    std::cout << " Batch of " << count << " " << s.m << "x" << s.n << "x"
+              << s.k << " (transA " << s.transA << ", transB " << s.transB
+              << ") is incorrect" << std::endl;
+  }
+  return error;
+}
+
+/* Checks that both versions of batched_gemm reject a batch whose problems
+ * write to the same C.
+ * Returns true if there is an error. */
+bool check_shared_c(queue& q) {
+  gemm_shape s = make_gemm_shape(4, 4, 4);
+  std::vector<float> A(32, 1.0f), B(32, 1.0f), C(16, 0.0f);
+  std::vector<int> offA = {0, 16}, offB = {0, 16}, offC = {0, 0};
+  buffer<float, 1> bA(A.data(), range<1>(A.size()));
+  buffer<float, 1> bB(B.data(), range<1>(B.size()));
+  buffer<float, 1> bC(C.data(), range<1>(C.size()));
+  buffer<int, 1> bOffA(offA.data(), range<1>(2));
+  buffer<int, 1> bOffB(offB.data(), range<1>(2));
+  buffer<int, 1> bOffC(offC.data(), range<1>(2));
+  int rejected = 0;
+  try {
+    batched_gemm(q, s, 2, 1.0f, bA, 16, bB, 16, 0.0f, bC, 0);
+  } catch (const std::out_of_range&) {
+    rejected++;
+  }
+  try {
+    batched_gemm(q, s, 2, 1.0f, bA, bOffA, bB, bOffB, 0.0f, bC, bOffC);
+  } catch (const std::out_of_range&) {
+    rejected++;
+  }
+  if (rejected != 2) {
+    std::cout << " A batch whose problems share C was accepted" << std::endl;
+  }
+  return rejected != 2;
+}
+
+int main(int argc, char* argv[]) {
+  int count = (argc > 1) ? std::atoi(argv[1]) : 1000;
+  int matSize = (argc > 2) ? std::atoi(argv[2]) : 32;
+  if (count <= 0 || matSize <= 0) {
+    std::cout << "Usage: " << argv[0] << " [batch size] [matrix size]"
+              << std::endl;
+    return 1;
+  }
+  queue q;
+  std::mt19937 rng(count);
+  bool error = false;
+
+  // Square problems, and odd ones with every layout
+  error =
+      check_batch(q, make_gemm_shape(matSize, matSize, matSize), 37, rng) ||
+      error;
+  for (int t = 0; t < 4; t++) {
+    gemm_shape s = make_gemm_shape(13, 7, 9 + matSize, t & 1, t & 2);
+    s.lda += 1;
+    s.ldc += 3;
+    error = check_batch(q, s, 37, rng) || error;
+  }
+  error = check_shared_c(q) || error;
+
+  gemm_shape s = make_gemm_shape(matSize, matSize, matSize);
+  batch_data d = make_batch(s, count, rng);
+  std::vector<float> C(d.C.size(), 0.0f);
+  const double flops = 2.0 * count * matSize * matSize * matSize;
+
+  {
+    // One set of buffers and one kernel per problem, as local_mxm does
+    auto start = std::chrono::steady_clock::now();
+    for (int p = 0; p < count; p++) {
+      buffer<float, 1, map_allocator<float>> bA(d.A.data() + p * d.sizeA,
+                                                range<1>(d.sizeA));
+      buffer<float, 1, map_allocator<float>> bB(d.B.data() + p * d.sizeB,
+                                                range<1>(d.sizeB));
+      buffer<float, 1, map_allocator<float>> bC(C.data() + p * d.sizeC,
+                                                range<1>(d.sizeC));
+      tiled_gemm(q, s, 1.0f, bA, bB, 0.0f, bC, std::min(16, matSize));
+    }
+    q.wait_and_throw();
+    seconds_t elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "One kernel per problem: " << count / elapsed.count()
+              << " problems per second, " << flops / elapsed.count() * 1e-9
+              << " GFLOPs" << std::endl;
+  }
+
+  std::vector<float> batched(d.C.size(), 0.0f);
+  {
+    auto start = std::chrono::steady_clock::now();
+    {
+      buffer<float, 1, map_allocator<float>> bA(d.A.data(),
+                                                range<1>(d.A.size()));
+      buffer<float, 1, map_allocator<float>> bB(d.B.data(),
+                                                range<1>(d.B.size()));
+      buffer<float, 1, map_allocator<float>> bC(batched.data(),
+                                                range<1>(batched.size()));
+      batched_gemm(q, s, count, 1.0f, bA, d.sizeA, bB, d.sizeB, 0.0f, bC,
+                   d.sizeC);
+    }
+    seconds_t elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Batched kernel: " << count / elapsed.count()
+              << " problems per second, " << flops / elapsed.count() * 1e-9
+              << " GFLOPs" << std::endl;
+  }
+  error = compare("batched", batched, C) || error;
+
+  if (error) {
+    std::cout << "The results are incorrect" << std::endl;
+    return 1;
+  }
+  std::cout << "Success" << std::endl;
+  return 0;
+}
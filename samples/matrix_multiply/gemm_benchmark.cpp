@@ -0,0 +1,412 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  gemm_benchmark.cpp
+ *
+ *  Description:
+ *    Benchmark of the SYCL matrix multiplication kernels over a range of
+ *    sizes, timing the uploads, the kernel and the download separately.
+ *
+ **************************************************************************/
+
+/*  Every size and kernel is run a number of times after some untimed
+ *  warm-up runs. A run copies A and B from host memory to buffers that
+ *  only live on the device, multiplies them, and copies C back to host
+ *  memory, each step in its own command group, so the profiling events
+ *  of the queue give the time of each step on the device. The minimum,
+ *  median and 95th percentile of the runs are printed, and can be written
+ *  to a JSON file with one line per size and kernel, so the results of two
+ *  runs, for example before and after a driver upgrade, can be compared
+ *  with diff.
+ *  The kernels are the specializations of gemm_dispatch.hpp that the
+ *  device supports, and the generic tiled_gemm with the tile size of each
+ *  specialization of tiled_gemm, so the speedup of compiling the kernel
+ *  for a tile size, which lets the compiler unroll its inner loop, is
+ *  printed too. */
+
+#include <CL/sycl.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gemm_dispatch.hpp"
+#include "host_gemm.hpp"
+#include "sycl_gemm.hpp"
+
+using namespace cl::sycl;
+
+/* Summary of the times of the runs of one step, in milliseconds */
+struct timing_stats {
+  double min;
+  double median;
+  double p95;
+};
+
+/* Computes the summary of the times. The percentiles are the nearest
+ * rank ones, so they are always one of the times. */
+timing_stats summarize(std::vector<double> times) {
+  std::sort(times.begin(), times.end());
+  auto rank = [&](double p) {
+    auto r = static_cast<std::size_t>(std::ceil(p * times.size()));
+    return times[std::max<std::size_t>(r, 1) - 1];
+  };
+  return timing_stats{times.front(), rank(0.5), rank(0.95)};
+}
+
+/* Time between the start and the end of the command of the event */
+double event_ms(const event& e) {
+  auto start = e.get_profiling_info<info::event_profiling::command_start>();
+  auto end = e.get_profiling_info<info::event_profiling::command_end>();
+  return (end - start) * 1e-6;
+}
+
+/* A kernel of the benchmark: a specialization of gemm_dispatch.hpp, or
+ * the generic kernel with a tile size */
+struct benchmark_kernel {
+  std::string name;
+  int specialization;
+  int tileSize;
+};
+
+/* The specializations that the device supports for float matrices, each
+ * specialization of tiled_gemm preceded by the generic kernel with the
+ * same tile size */
+std::vector<benchmark_kernel> benchmark_kernels(const device& d) {
+  std::vector<benchmark_kernel> kernels;
+  const auto& table = gemm_specializations();
+  for (std::size_t i = 0; i < table.size(); i++) {
+    if (!specialization_supported(table[i], d, sizeof(float))) {
+      continue;
+    }
+    if (table[i].variant == kernel_variant::tiled) {
+      kernels.push_back(benchmark_kernel{
+          "tiled_gemm(" + std::to_string(table[i].tile_size()) + ")",
+          generic_gemm, table[i].tile_size()});
+    }
+    kernels.push_back(
+        benchmark_kernel{table[i].name, int(i), table[i].tile_size()});
+  }
+  return kernels;
+}
+
+/* Results of one size and kernel */
+struct benchmark_result {
+  std::string kernel;
+  int size;
+  int tileSize;
+  timing_stats upload;
+  timing_stats compute;
+  timing_stats download;
+  /* Time from the first upload to the end of the download, on the host */
+  timing_stats total;
+  /* Rate of the kernel, from its median time */
+  double gflops;
+  bool correct;
+};
+
+struct benchmark_options {
+  std::vector<int> sizes;
+  int repetitions;
+  int warmup;
+  std::string jsonPath;
+};
+
+/* Speedup of a specialization of tiled_gemm over the generic kernel with
+ * the same tile size, from their median kernel times */
+struct unrolling_result {
+  int size;
+  int tileSize;
+  double speedup;
+};
+
+/* Runs the kernel on matrices of size x size elements, warmup times
+ * untimed and repetitions times timed, and checks the result of the last
+ * run against the host. */
+benchmark_result run_benchmark(queue& q, const benchmark_kernel& kernel,
+                               int size, const benchmark_options& options) {
+  using seconds_t = std::chrono::duration<double>;
+  const std::size_t count = std::size_t(size) * size;
+  std::vector<float> A(count), B(count), C(count, 0.0f);
+  std::mt19937 rng(size);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  for (std::size_t i = 0; i < count; i++) {
+    A[i] = dist(rng);
+    B[i] = dist(rng);
+  }
+
+  benchmark_result result;
+  result.kernel = kernel.name;
+  result.size = size;
+  result.tileSize = kernel.tileSize;
+
+  // Buffers without host memory, so the only copies are the explicit ones
+  buffer<float, 1> dA{range<1>(count)};
+  buffer<float, 1> dB{range<1>(count)};
+  buffer<float, 1> dC{range<1>(count)};
+  const gemm_shape s = make_gemm_shape(size, size, size);
+
+  std::vector<double> upload, computeTimes, download, total;
+  for (int r = 0; r < options.warmup + options.repetitions; r++) {
+    auto start = std::chrono::steady_clock::now();
+    auto upA = q.submit([&](handler& cgh) {
+      cgh.copy(A.data(), dA.get_access<access::mode::discard_write>(cgh));
+    });
+    auto upB = q.submit([&](handler& cgh) {
+      cgh.copy(B.data(), dB.get_access<access::mode::discard_write>(cgh));
+    });
+    auto compute = run_specialized_gemm(q, kernel.specialization, s, 1.0f,
+                                        dA, dB, 0.0f, dC, kernel.tileSize);
+    auto down = q.submit([&](handler& cgh) {
+      cgh.copy(dC.get_access<access::mode::read>(cgh), C.data());
+    });
+    down.wait();
+    seconds_t elapsed = std::chrono::steady_clock::now() - start;
+    if (r < options.warmup) {
+      continue;
+    }
+    upload.push_back(event_ms(upA) + event_ms(upB));
+    computeTimes.push_back(event_ms(compute));
+    download.push_back(event_ms(down));
+    total.push_back(elapsed.count() * 1e3);
+  }
+  q.wait_and_throw();
+
+  result.upload = summarize(upload);
+  result.compute = summarize(computeTimes);
+  result.download = summarize(download);
+  result.total = summarize(total);
+  result.gflops = 2.0 * size * size * size / (result.compute.median * 1e6);
+
+  std::vector<float> expected(count, 0.0f);
+  host_gemm(false, false, size, size, size, 1.0f, A.data(), size, B.data(),
+            size, 0.0f, expected.data(), size);
+  result.correct = true;
+  for (std::size_t i = 0; i < count && result.correct; i++) {
+    float diff = std::fabs(C[i] - expected[i]);
+    if (diff > 1e-3f * std::fabs(expected[i]) + 1e-3f) {
+      std::cout << " " << result.kernel << " " << size << ": element " << i
+                << " differs: " << C[i] << " != " << expected[i]
+                << std::endl;
+      result.correct = false;
+    }
+  }
+  return result;
+}
+
+/* Quotes a string for JSON */
+std::string json_string(const std::string& s) {
+  std::ostringstream out;
+  out << '"';
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escaped[8];
+      std::snprintf(escaped, sizeof(escaped), "\\u%04x",
+                    static_cast<unsigned>(c));
+      out << escaped;
+    } else {
+      out << c;
+    }
+  }
+  out << '"';
+  return out.str();
+}
+
+std::string json_stats(const timing_stats& t) {
+  std::ostringstream out;
+  out << std::fixed << std::setprecision(4) << "{\"min\": " << t.min
+      << ", \"median\": " << t.median << ", \"p95\": " << t.p95 << "}";
+  return out.str();
+}
+
+/* Writes the results as JSON. The keys are always in the same order and
+ * every result is on its own line, so two files can be compared line by
+ * line. */
+void write_json(std::ostream& out, const device& d,
+                const benchmark_options& options,
+                const std::vector<benchmark_result>& results,
+                const std::vector<unrolling_result>& unrolling) {
+  out << "{\n";
+  out << "  \"device\": " << json_string(d.get_info<info::device::name>())
+      << ",\n";
+  out << "  \"driver\": "
+      << json_string(d.get_info<info::device::driver_version>()) << ",\n";
+  out << "  \"repetitions\": " << options.repetitions << ",\n";
+  out << "  \"warmup\": " << options.warmup << ",\n";
+  out << "  \"unit\": \"ms\",\n";
+  out << "  \"results\": [\n";
+  for (std::size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    out << "    {\"kernel\": " << json_string(r.kernel)
+        << ", \"size\": " << r.size << ", \"tile_size\": " << r.tileSize
+        << ", \"upload\": " << json_stats(r.upload)
+        << ", \"kernel_time\": " << json_stats(r.compute)
+        << ", \"download\": " << json_stats(r.download)
+        << ", \"total\": " << json_stats(r.total) << ", \"gflops\": "
+        << std::fixed << std::setprecision(2) << r.gflops
+        << ", \"correct\": " << (r.correct ? "true" : "false") << "}"
+        << ((i + 1 < results.size()) ? "," : "") << "\n";
+  }
+  out << "  ],\n";
+  out << "  \"unrolling_speedup\": [\n";
+  for (std::size_t i = 0; i < unrolling.size(); i++) {
+    const auto& u = unrolling[i];
+    out << "    {\"size\": " << u.size << ", \"tile_size\": " << u.tileSize
+        << ", \"speedup\": " << std::fixed << std::setprecision(3)
+        << u.speedup << "}" << ((i + 1 < unrolling.size()) ? "," : "")
+        << "\n";
+  }
+  out << "  ]\n";
+  out << "}\n";
+}
+
+void print_result(const benchmark_result& r) {
+  auto print = [](const char* name, const timing_stats& t) {
+    std::cout << "  " << std::left << std::setw(10) << name << std::right
+              << std::fixed << std::setprecision(4) << " min "
+              << std::setw(10) << t.min << "  median " << std::setw(10)
+              << t.median << "  p95 " << std::setw(10) << t.p95 << " ms"
+              << std::endl;
+  };
+  std::cout << r.kernel << ", " << r.size << " x " << r.size
+            << ", tiles of " << r.tileSize << ": " << std::fixed
+            << std::setprecision(2) << r.gflops << " GFLOPs"
+            << (r.correct ? "" : " (incorrect)") << std::endl;
+  print("upload", r.upload);
+  print("kernel", r.compute);
+  print("download", r.download);
+  print("total", r.total);
+}
+
+/* Reads a comma separated list of positive integers */
+bool parse_sizes(const std::string& list, std::vector<int>& sizes) {
+  std::istringstream in(list);
+  std::string item;
+  sizes.clear();
+  while (std::getline(in, item, ',')) {
+    int size = std::atoi(item.c_str());
+    if (size <= 0) {
+      return false;
+    }
+    sizes.push_back(size);
+  }
+  return !sizes.empty();
+}
+
+void usage(const std::string& programName) {
+  std::cout << "Usage: " << programName
+            << " [--sizes n1,n2,...] [--reps count] [--warmup count]"
+            << " [--json file]" << std::endl;
+  std::cout << " The default sizes are 128,256,512,1024,2048, with 10"
+            << " repetitions after 2 warm-up runs." << std::endl;
+  std::cout << " The file - writes the JSON results to the standard output"
+            << " instead of the table." << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+  benchmark_options options;
+  options.sizes = {128, 256, 512, 1024, 2048};
+  options.repetitions = 10;
+  options.warmup = 2;
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 1;
+    }
+    std::string value = argv[++i];
+    bool valid = true;
+    if (arg == "--sizes") {
+      valid = parse_sizes(value, options.sizes);
+    } else if (arg == "--reps") {
+      options.repetitions = std::atoi(value.c_str());
+      valid = options.repetitions > 0;
+    } else if (arg == "--warmup") {
+      options.warmup = std::atoi(value.c_str());
+      valid = options.warmup >= 0;
+    } else if (arg == "--json") {
+      options.jsonPath = value;
+    } else {
+      valid = false;
+    }
+    if (!valid) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  queue q(default_selector(),
+          property_list{property::queue::enable_profiling()});
+  const bool tableOutput = (options.jsonPath != "-");
+  const auto kernels = benchmark_kernels(q.get_device());
+  std::vector<benchmark_result> results;
+  std::vector<unrolling_result> unrolling;
+  bool error = false;
+  for (int size : options.sizes) {
+    for (std::size_t i = 0; i < kernels.size(); i++) {
+      results.push_back(run_benchmark(q, kernels[i], size, options));
+      error = error || !results.back().correct;
+      if (tableOutput) {
+        print_result(results.back());
+      }
+      if (i > 0 && kernels[i - 1].specialization == generic_gemm) {
+        const auto& generic = results[results.size() - 2];
+        const auto& specialized = results.back();
+        unrolling.push_back(unrolling_result{
+            size, specialized.tileSize,
+            generic.compute.median / specialized.compute.median});
+        if (tableOutput) {
+          std::cout << "  speedup of " << specialized.kernel << " over "
+                    << generic.kernel << ": " << std::fixed
+                    << std::setprecision(3) << unrolling.back().speedup
+                    << std::endl;
+        }
+      }
+    }
+  }
+
+  if (options.jsonPath == "-") {
+    write_json(std::cout, q.get_device(), options, results, unrolling);
+  } else if (!options.jsonPath.empty()) {
+    std::ofstream out(options.jsonPath);
+    write_json(out, q.get_device(), options, results, unrolling);
+    if (!out) {
+      std::cout << "Cannot write " << options.jsonPath << std::endl;
+      return 1;
+    }
+  }
+
+  if (error) {
+    std::cout << "The results are incorrect" << std::endl;
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,148 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  gemm_dispatch.hpp
+ *
+ *  Description:
+ *    Table of the matrix multiplication kernels compiled for fixed tile
+ *    sizes, and the choice of one of them for a device and problem size.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_GEMM_DISPATCH_HPP
+#define INCLUDE_GEMM_DISPATCH_HPP
+
+#include <CL/sycl.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "autotuner.hpp"
+#include "sycl_gemm.hpp"
+
+/* Index of the generic kernel, tiled_gemm with a tile size known when it
+ * runs, which is used for the sizes that have no specialization */
+const int generic_gemm = -1;
+
+/* gemm_specializations.
+ * The specializations, in the order of the cases of run_specialized_gemm.
+ * There are tiles of C of 8, 16 and 32 elements computed one element per
+ * work-item, and tiles of 16 to 64 elements computed by micro-tiles of
+ * 2 x 2 and 4 x 4 elements per work-item.
+ */
+inline const std::vector<gemm_specialization>& gemm_specializations() {
+  static const std::vector<gemm_specialization> table = {
+      {"tiled_gemm<8>", kernel_variant::tiled, 8, 1, 8},
+      {"tiled_gemm<16>", kernel_variant::tiled, 16, 1, 16},
+      {"tiled_gemm<32>", kernel_variant::tiled, 32, 1, 32},
+      {"register_tiled_gemm<2, 2, 8>", kernel_variant::register_tiled, 8, 2,
+       16},
+      {"register_tiled_gemm<4, 4, 8>", kernel_variant::register_tiled, 8, 4,
+       16},
+      {"register_tiled_gemm<2, 2, 16, 32>", kernel_variant::register_tiled,
+       16, 2, 32},
+      {"register_tiled_gemm<4, 4, 16>", kernel_variant::register_tiled, 16,
+       4, 16}};
+  return table;
+}
+
+/* run_specialized_gemm.
+ * Enqueues the multiplication with the specialization of the given index
+ * in gemm_specializations, or with the generic kernel and tiles of
+ * genericTileSize for generic_gemm, and returns the event of the kernel.
+ * Throws std::out_of_range for other indices.
+ */
+template <typename T, typename AllocA, typename AllocB, typename AllocC>
+cl::sycl::event run_specialized_gemm(cl::sycl::queue& q, int index,
+                                     const gemm_shape& s, T alpha,
+                                     cl::sycl::buffer<T, 1, AllocA>& bA,
+                                     cl::sycl::buffer<T, 1, AllocB>& bB,
+                                     T beta,
+                                     cl::sycl::buffer<T, 1, AllocC>& bC,
+                                     int genericTileSize = 16) {
+  switch (index) {
+    case generic_gemm:
+      return tiled_gemm(q, s, alpha, bA, bB, beta, bC, genericTileSize);
+    case 0:
+      return tiled_gemm<8>(q, s, alpha, bA, bB, beta, bC);
+    case 1:
+      return tiled_gemm<16>(q, s, alpha, bA, bB, beta, bC);
+    case 2:
+      return tiled_gemm<32>(q, s, alpha, bA, bB, beta, bC);
+    case 3:
+      return register_tiled_gemm<2, 2, 8>(q, s, alpha, bA, bB, beta, bC);
+    case 4:
+      return register_tiled_gemm<4, 4, 8>(q, s, alpha, bA, bB, beta, bC);
+    case 5:
+      return register_tiled_gemm<2, 2, 16, 32>(q, s, alpha, bA, bB, beta,
+                                               bC);
+    case 6:
+      return register_tiled_gemm<4, 4, 16>(q, s, alpha, bA, bB, beta, bC);
+    default:
+      throw std::out_of_range("There is no GEMM specialization " +
+                              std::to_string(index));
+  }
+}
+
+/* choose_gemm_specialization.
+ * Returns the index of the fastest specialization that the device of the
+ * queue supports for square matrices of matSize elements, or generic_gemm
+ * if the generic kernel, with the largest tile size that the device
+ * supports up to 16, is faster than all of them. The choice is timed with
+ * zero matrices the first time, and then kept in the cache of the tuner
+ * for the device and the size class of matSize, so the table is only
+ * timed once for the problems of similar sizes.
+ */
+template <typename T>
+int choose_gemm_specialization(codeplay::autotuner& tuner,
+                               cl::sycl::queue& q, int matSize) {
+  using namespace cl::sycl;
+  const auto& table = gemm_specializations();
+  std::vector<codeplay::tuning_params> candidates = {{generic_gemm}};
+  for (std::size_t i = 0; i < table.size(); i++) {
+    if (specialization_supported(table[i], q.get_device(), sizeof(T))) {
+      candidates.push_back({int(i)});
+    }
+  }
+  const int genericTileSize = std::min(16, device_block_size(q));
+  std::vector<T> A(std::size_t(matSize) * matSize, T(0));
+  std::vector<T> B(A);
+  std::vector<T> C(A);
+  auto kernel = "specialized gemm, " + std::to_string(sizeof(T) * 8) + "-bit";
+  // The handler of q may not rethrow the errors of a failing candidate
+  queue tuningQueue(q.get_device(), codeplay::rethrow_async_errors);
+  auto result = tuner.tune(
+      q.get_device(), kernel, matSize, candidates,
+      [&](const codeplay::tuning_params& params) {
+        buffer<T, 1> bA(A.data(), range<1>(A.size()));
+        buffer<T, 1> bB(B.data(), range<1>(B.size()));
+        buffer<T, 1> bC(C.data(), range<1>(C.size()));
+        run_specialized_gemm(tuningQueue, params[0],
+                             make_gemm_shape(matSize, matSize, matSize), T(1),
+                             bA, bB, T(0), bC, genericTileSize);
+        tuningQueue.wait_and_throw();
+      });
+  return result.params[0];
+}
+
+#endif  // INCLUDE_GEMM_DISPATCH_HPP
@@ -0,0 +1,419 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  host_gemm.hpp
+ *
+ *  Description:
+ *    Cache-blocked matrix multiplication on the host, with SIMD
+ *    micro-kernels selected when the program starts, used as the
+ *    reference and fallback of the SYCL matrix multiplication.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_HOST_GEMM_HPP
+#define INCLUDE_HOST_GEMM_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#if defined(_OPENMP)
+#include <omp.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+/* The SIMD micro-kernels are only compiled for the host, on x86-64
+ * compilers that can target an instruction set per function. */
+#if !defined(__SYCL_DEVICE_ONLY__) && defined(__x86_64__) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define HOST_GEMM_X86
+#include <immintrin.h>
+#endif
+
+/* host_gemm_kernel
+ * Micro-kernel of the host GEMM. It multiplies an mr x kc panel of A by a
+ * kc x nr panel of B, both packed in the order the kernel reads them, and
+ * adds the mr x nr result to C, whose rows are ldc elements apart.
+ */
+template <typename T>
+struct host_gemm_kernel {
+  const char* name;
+  int mr;
+  int nr;
+  void (*compute)(int kc, const T* a, const T* b, T* c, int ldc);
+};
+
+namespace host_gemm_detail {
+
+/* Largest mr x nr tile of any kernel, for the partial tiles of C */
+const int max_tile = 16 * 32;
+
+/* Alignment of the packed panels, so that kernels use aligned loads */
+const std::size_t alignment = 64;
+
+/* Portable kernel that the compiler can vectorize */
+template <typename T, int MR, int NR>
+void compute_generic(int kc, const T* a, const T* b, T* c, int ldc) {
+  T acc[MR][NR] = {};
+  for (int p = 0; p < kc; p++) {
+    for (int i = 0; i < MR; i++) {
+      for (int j = 0; j < NR; j++) {
+        acc[i][j] += a[i] * b[j];
+      }
+    }
+    a += MR;
+    b += NR;
+  }
+  for (int i = 0; i < MR; i++) {
+    for (int j = 0; j < NR; j++) {
+      c[i * ldc + j] += acc[i][j];
+    }
+  }
+}
+
+#ifdef HOST_GEMM_X86
+
+/* 6 x 16 kernel: the 12 accumulators, 2 rows of B and a broadcast
+ * element of A fill 15 of the 16 AVX registers. */
+__attribute__((target("avx2,fma"))) inline void compute_avx2(
+    int kc, const float* a, const float* b, float* c, int ldc) {
+  __m256 acc[6][2];
+#pragma GCC unroll 6
+  for (int i = 0; i < 6; i++) {
+    acc[i][0] = _mm256_setzero_ps();
+    acc[i][1] = _mm256_setzero_ps();
+  }
+  for (int p = 0; p < kc; p++) {
+    __m256 b0 = _mm256_load_ps(b);
+    __m256 b1 = _mm256_load_ps(b + 8);
+#pragma GCC unroll 6
+    for (int i = 0; i < 6; i++) {
+      __m256 ai = _mm256_broadcast_ss(a + i);
+      acc[i][0] = _mm256_fmadd_ps(ai, b0, acc[i][0]);
+      acc[i][1] = _mm256_fmadd_ps(ai, b1, acc[i][1]);
+    }
+    a += 6;
+    b += 16;
+  }
+#pragma GCC unroll 6
+  for (int i = 0; i < 6; i++) {
+    float* row = c + i * ldc;
+    _mm256_storeu_ps(row, _mm256_add_ps(_mm256_loadu_ps(row), acc[i][0]));
+    _mm256_storeu_ps(row + 8,
+                     _mm256_add_ps(_mm256_loadu_ps(row + 8), acc[i][1]));
+  }
+}
+
+/* 12 x 32 kernel: 24 accumulators, 2 rows of B and a broadcast element
+ * of A out of the 32 AVX-512 registers. */
+__attribute__((target("avx512f"))) inline void compute_avx512(
+    int kc, const float* a, const float* b, float* c, int ldc) {
+  __m512 acc[12][2];
+#pragma GCC unroll 12
+  for (int i = 0; i < 12; i++) {
+    acc[i][0] = _mm512_setzero_ps();
+    acc[i][1] = _mm512_setzero_ps();
+  }
+  for (int p = 0; p < kc; p++) {
+    __m512 b0 = _mm512_load_ps(b);
+    __m512 b1 = _mm512_load_ps(b + 16);
+#pragma GCC unroll 12
+    for (int i = 0; i < 12; i++) {
+      __m512 ai = _mm512_set1_ps(a[i]);
+      acc[i][0] = _mm512_fmadd_ps(ai, b0, acc[i][0]);
+      acc[i][1] = _mm512_fmadd_ps(ai, b1, acc[i][1]);
+    }
+    a += 12;
+    b += 32;
+  }
+#pragma GCC unroll 12
+  for (int i = 0; i < 12; i++) {
+    float* row = c + i * ldc;
+    _mm512_storeu_ps(row, _mm512_add_ps(_mm512_loadu_ps(row), acc[i][0]));
+    _mm512_storeu_ps(row + 16,
+                     _mm512_add_ps(_mm512_loadu_ps(row + 16), acc[i][1]));
+  }
+}
+
+#endif  // HOST_GEMM_X86
+
+/* Memory aligned to the packing alignment */
+template <typename T>
+class aligned_buffer {
+ public:
+  explicit aligned_buffer(std::size_t n)
+      : m_storage(new char[n * sizeof(T) + alignment]) {
+    std::uintptr_t p = reinterpret_cast<std::uintptr_t>(m_storage.get());
+    m_data = reinterpret_cast<T*>((p + alignment - 1) & ~(alignment - 1));
+  }
+
+  T* get() const { return m_data; }
+
+ private:
+  std::unique_ptr<char[]> m_storage;
+  T* m_data;
+};
+
+/* cache_size.
+ * Returns the size of the given data cache level in bytes, or
+ * defaultSize when the system does not report it.
+ */
+inline std::size_t cache_size(int level, std::size_t defaultSize) {
+  long size = 0;
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+  switch (level) {
+    case 1:
+      size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+      break;
+    case 2:
+      size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+      break;
+    default:
+      size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+      break;
+  }
+#else
+  (void)level;
+#endif  // _SC_LEVEL1_DCACHE_SIZE
+  return (size > 0) ? static_cast<std::size_t>(size) : defaultSize;
+}
+
+/* Matrix of the given strides between rows and columns, so the packing
+ * routines read transposed and non-transposed operands the same way. */
+template <typename T>
+struct strided_matrix {
+  const T* m_data;
+  int m_rowStride;
+  int m_colStride;
+
+  T operator()(int i, int j) const {
+    return m_data[i * m_rowStride + j * m_colStride];
+  }
+};
+
+/* pack_a.
+ * Copies the mc x kc block of A at (i0, p0), scaled by alpha, into
+ * panels of mr rows, each stored column by column. Rows after the end
+ * of A are filled with zeros.
+ */
+template <typename T>
+void pack_a(const strided_matrix<T>& A, int i0, int p0, int mc, int kc,
+            int mr, T alpha, T* packed) {
+  for (int ir = 0; ir < mc; ir += mr) {
+    int rows = std::min(mr, mc - ir);
+    for (int p = 0; p < kc; p++) {
+      for (int i = 0; i < rows; i++) {
+        packed[i] = alpha * A(i0 + ir + i, p0 + p);
+      }
+      for (int i = rows; i < mr; i++) {
+        packed[i] = T(0);
+      }
+      packed += mr;
+    }
+  }
+}
+
+/* pack_b.
+ * Copies the nr columns of the kc x nc block of B at (p0, j0) that start
+ * at column jr of the block into a panel stored row by row.
+ * Columns after the end of B are filled with zeros.
+ */
+template <typename T>
+void pack_b(const strided_matrix<T>& B, int p0, int j0, int kc, int nc,
+            int jr, int nr, T* packed) {
+  int cols = std::min(nr, nc - jr);
+  for (int p = 0; p < kc; p++) {
+    for (int j = 0; j < cols; j++) {
+      packed[j] = B(p0 + p, j0 + jr + j);
+    }
+    for (int j = cols; j < nr; j++) {
+      packed[j] = T(0);
+    }
+    packed += nr;
+  }
+}
+
+inline int num_threads() {
+#if defined(_OPENMP)
+  return omp_get_max_threads();
+#else
+  return 1;
+#endif
+}
+
+inline int thread_id() {
+#if defined(_OPENMP)
+  return omp_get_thread_num();
+#else
+  return 0;
+#endif
+}
+
+}  // namespace host_gemm_detail
+
+/* host_gemm_kernels.
+ * Returns the kernels for T that the processor supports, the fastest
+ * first. The portable kernel is always the last one.
+ */
+template <typename T>
+std::vector<host_gemm_kernel<T>> host_gemm_kernels() {
+  using namespace host_gemm_detail;
+  return {{"generic", 4, 8, compute_generic<T, 4, 8>}};
+}
+
+template <>
+inline std::vector<host_gemm_kernel<float>> host_gemm_kernels<float>() {
+  using namespace host_gemm_detail;
+  std::vector<host_gemm_kernel<float>> kernels;
+#ifdef HOST_GEMM_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    kernels.push_back({"avx512", 12, 32, compute_avx512});
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    kernels.push_back({"avx2", 6, 16, compute_avx2});
+  }
+#endif  // HOST_GEMM_X86
+  kernels.push_back({"generic", 6, 16, compute_generic<float, 6, 16>});
+  return kernels;
+}
+
+/* host_gemm_default_kernel.
+ * Fastest kernel for T, detected once.
+ */
+template <typename T>
+const host_gemm_kernel<T>& host_gemm_default_kernel() {
+  static const host_gemm_kernel<T> theKernel = host_gemm_kernels<T>().front();
+  return theKernel;
+}
+
+/* host_gemm.
+ * Computes C = alpha * op(A) * op(B) + beta * C for row-major matrices,
+ * where op(A) is M x K, op(B) is K x N and C is M x N, and op(X) is X or
+ * its transpose depending on transA and transB. lda, ldb and ldc are the
+ * number of elements between the rows of A, B and C.
+ *
+ * The loops follow the usual structure of optimized BLAS libraries:
+ *  - B is split in kc x nc panels that fit in the last level cache and
+ *    are packed once, shared by all the threads,
+ *  - A is split in mc x kc blocks that fit in the L2 cache, each packed
+ *    by the thread that uses it,
+ *  - the micro-kernel multiplies an mr x kc sliver of the A block by a
+ *    kc x nr sliver of the B panel, which stays in the L1 cache, keeping
+ *    the mr x nr tile of C in registers.
+ * The blocks of A are distributed among the OpenMP threads.
+ */
+template <typename T>
+void host_gemm(
+    bool transA, bool transB, int M, int N, int K, T alpha, const T* A,
+    int lda, const T* B, int ldb, T beta, T* C, int ldc,
+    const host_gemm_kernel<T>& kernel = host_gemm_default_kernel<T>()) {
+  using namespace host_gemm_detail;
+  if (M <= 0 || N <= 0) {
+    return;
+  }
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      // beta == 0 overwrites C, even if it contains NaNs
+      C[i * ldc + j] = (beta == T(0)) ? T(0) : beta * C[i * ldc + j];
+    }
+  }
+  if (K <= 0 || alpha == T(0)) {
+    return;
+  }
+
+  const int mr = kernel.mr;
+  const int nr = kernel.nr;
+  const int numThreads = num_threads();
+  // A kc x nr sliver of B fills the L1 cache, longer slivers amortize
+  // the loads and stores of the tile of C in the micro-kernel
+  int kc = static_cast<int>(cache_size(1, 32 * 1024) / (nr * sizeof(T)));
+  kc = std::max(128, std::min(kc, 512));
+  // An mc x kc block of A takes a quarter of the L2 cache, which leaves
+  // room for the slivers of B that go through it
+  int mc = static_cast<int>(cache_size(2, 256 * 1024) / 4 / (kc * sizeof(T)));
+  mc = std::max(mr, mc / mr * mr);
+  // Small matrices are split so that every thread has a block
+  int mcShared = ((M + numThreads - 1) / numThreads + mr - 1) / mr * mr;
+  mc = std::min(mc, std::max(mr, mcShared));
+  // A kc x nc panel of B takes half of the last level cache
+  int nc = static_cast<int>(cache_size(3, 4 * 1024 * 1024) / 2 /
+                            (kc * sizeof(T)));
+  nc = std::max(nr, std::min(nc, 4096) / nr * nr);
+  kc = std::min(kc, K);
+  nc = std::min(nc, (N + nr - 1) / nr * nr);
+
+  strided_matrix<T> a{A, transA ? 1 : lda, transA ? lda : 1};
+  strided_matrix<T> b{B, transB ? 1 : ldb, transB ? ldb : 1};
+  aligned_buffer<T> packedB(static_cast<std::size_t>(kc) * nc);
+  aligned_buffer<T> packedA(static_cast<std::size_t>(numThreads) *
+                            (mc + mr) * kc);
+
+  for (int jc = 0; jc < N; jc += nc) {
+    int ncCur = std::min(nc, N - jc);
+    for (int pc = 0; pc < K; pc += kc) {
+      int kcCur = std::min(kc, K - pc);
+      int numSlivers = (ncCur + nr - 1) / nr;
+#pragma omp parallel
+      {
+#pragma omp for schedule(static)
+        for (int s = 0; s < numSlivers; s++) {
+          pack_b(b, pc, jc, kcCur, ncCur, s * nr, nr,
+                 packedB.get() + static_cast<std::size_t>(s) * nr * kcCur);
+        }
+        T* myA = packedA.get() +
+                 static_cast<std::size_t>(thread_id()) * (mc + mr) * kc;
+#pragma omp for schedule(dynamic, 1)
+        for (int ic = 0; ic < M; ic += mc) {
+          int mcCur = std::min(mc, M - ic);
+          pack_a(a, ic, pc, mcCur, kcCur, mr, alpha, myA);
+          for (int jr = 0; jr < ncCur; jr += nr) {
+            const T* bSliver = packedB.get() + jr * kcCur;
+            int cols = std::min(nr, ncCur - jr);
+            for (int ir = 0; ir < mcCur; ir += mr) {
+              const T* aSliver = myA + ir * kcCur;
+              int rows = std::min(mr, mcCur - ir);
+              T* c = C + (ic + ir) * ldc + jc + jr;
+              if (rows == mr && cols == nr) {
+                kernel.compute(kcCur, aSliver, bSliver, c, ldc);
+              } else {
+                // Partial tiles go through a full tile on the stack
+                T tile[max_tile] = {};
+                kernel.compute(kcCur, aSliver, bSliver, tile, nr);
+                for (int i = 0; i < rows; i++) {
+                  for (int j = 0; j < cols; j++) {
+                    c[i * ldc + j] += tile[i * nr + j];
+                  }
+                }
+              }
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+#endif  // INCLUDE_HOST_GEMM_HPP
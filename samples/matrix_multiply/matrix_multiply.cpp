@@ -25,18 +25,29 @@
  *
  **************************************************************************/
 
-/*  This example compares an OpenMP blocked matrix multiplication
- *  implementation with a SYCL blocked matrix multiplication example.
- *  The purpose is not to compare performance, but to show the similarities
- *  and differences between them.
- *  See block_host for the OpenMP implementation. */
+/*  This example compares a blocked matrix multiplication on the host,
+ *  parallelized with OpenMP, with a SYCL blocked matrix multiplication.
+ *  Both split the matrices in tiles that fit in fast memory: the cache of
+ *  the host processor, or the local memory of the device.
+ *  See block_host for the host implementation, in host_gemm.hpp. */
 
 #include <CL/sycl.hpp>
 
 #include <iostream>
+#include <limits>
 #include <ctime>
 #include <chrono>
 #include <cmath>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "autotuner.hpp"
+#include "gemm_dispatch.hpp"
+#include "host_gemm.hpp"
+#include "strassen_gemm.hpp"
+#include "streamed_gemm.hpp"
+#include "sycl_gemm.hpp"
 
 using namespace cl::sycl;
 
@@ -56,85 +67,77 @@ void display_matrix(float *m, int matSize) {
   ;
 }
 
-/* Implements a host C++ version of the matrix multiplication.
- * If compiler supports OpenMP, code is parallelized. Scheduling
- * uses static chunks of block_size. */
+/* Implements a host C++ version of the matrix multiplication, MC += MA * MB.
+ * The matrices are packed in blocks sized for the caches of the processor
+ * and multiplied with the fastest SIMD micro-kernel it supports. If the
+ * compiler supports OpenMP, the blocks are distributed among threads. */
 void block_host(float *MA, float *MB, float *MC, int matSize) {
-  /* We set the block size to 32 for simplicity, though the optimal
-   * value will depend on the platform this is run on. */
-  int block_size = 32;
-  int numBlocks = block_size / matSize;
-  int extraBlockLength = block_size % matSize;
-  numBlocks = extraBlockLength ? (numBlocks + 1) : (numBlocks);
-
-#pragma omp parallel for collapse(2)
-  for (int bIndexI = 0; bIndexI < matSize; bIndexI += block_size)
-    for (int bIndexJ = 0; bIndexJ < matSize; bIndexJ += block_size)
-      for (int bIndexK = 0; bIndexK < matSize; bIndexK += block_size) {
-        int i = bIndexI;
-        int j = bIndexJ;
-        int k = bIndexK;
-        for (int bi = i; bi < std::min(i + block_size, matSize); bi++)
-          for (int bj = j; bj < std::min(j + block_size, matSize); bj++)
-            for (int bk = k; bk < std::min(k + block_size, matSize); bk++) {
-              MC[(bi)*matSize + (bj)] +=
-                  MA[(bi)*matSize + (bk)] * MB[(bk)*matSize + (bj)];
-            }
-      }
+  host_gemm(false, false, matSize, matSize, matSize, 1.0f, MA, matSize, MB,
+            matSize, 1.0f, MC, matSize);
 }
 
-/* Obtains the previous power of two from the given integer.
- * It works by masking out all ones after the first one bit,
- * then leaves the first one bit intact, effectively
- * yielding the first power of two < x. */
-inline int prevPowerOfTwo(int x) {
-  if (x < 0) {
-    return 0;
+/* Chooses the blockSize of run_gemm for the variant by timing the
+ * multiplication of zero matrices of the same size with every candidate:
+ * the powers of two from 4 up to the largest square work-group for the
+ * tiled kernel, and 8 and 16 for the register-tiled kernel. The choice is
+ * kept in the cache of the tuner, so it is only timed the first time the
+ * sample runs on a device with a size of the same size class. */
+template <typename T>
+codeplay::tuning_result tune_block_size(codeplay::autotuner &tuner,
+                                        cl::sycl::queue &q,
+                                        kernel_variant variant, int matSize) {
+  int maxBlockSize = std::min(device_block_size(q), matSize);
+  std::vector<codeplay::tuning_params> candidates;
+  if (variant == kernel_variant::register_tiled) {
+    for (int b : {8, 16}) {
+      if (b <= maxBlockSize) {
+        candidates.push_back({b});
+      }
+    }
+  } else {
+    for (int b = 4; b <= maxBlockSize; b *= 2) {
+      candidates.push_back({b});
+    }
   }
-  --x;
-  x |= x >> 1;
-  x |= x >> 2;
-  x |= x >> 4;
-  x |= x >> 8;
-  x |= x >> 16;
-  return x - (x >> 1);
+  if (candidates.empty()) {
+    candidates.push_back({maxBlockSize});
+  }
+  std::vector<T> A(matSize * matSize, T(0));
+  std::vector<T> B(A);
+  std::vector<T> C(A);
+  auto kernel = std::string(variant_name(variant)) + " gemm, " +
+                std::to_string(sizeof(T) * 8) + "-bit";
+  /* The handler of q only prints the asynchronous errors, so the candidates
+   * run on a queue that rethrows them, and a failing one is skipped. */
+  queue tuningQueue(q.get_device(), codeplay::rethrow_async_errors);
+  return tuner.tune(q.get_device(), kernel, matSize, candidates,
+                    [&](const codeplay::tuning_params &params) {
+                      buffer<T, 1> bA(A.data(), range<1>(A.size()));
+                      buffer<T, 1> bB(B.data(), range<1>(B.size()));
+                      buffer<T, 1> bC(C.data(), range<1>(C.size()));
+                      run_gemm(tuningQueue, variant,
+                               make_gemm_shape(matSize, matSize, matSize),
+                               T(1), bA, bB, T(0), bC, params[0]);
+                      tuningQueue.wait_and_throw();
+                    });
 }
 
-/* Checks if X is a power of two.
- * If there are bits sets to one after AND with the
- * previous number, then it is not a power of two.
- */
-inline bool isPowerOfTwo(int x) { return (x & (x - 1)) == 0; }
-
 /* Function template that performs the matrix * matrix operation. (It is
  * a template because only some OpenCL devices support double-precision
  * floating-point numbers, but it is interesting to make the comparison
  * where available.)
- * Broadly, the function chooses an appropriate work size, then enqueues
- * the matrix * matrix lambda on the queue provided. Because the queues
- * are constructed inside this function, it will block until the work is
- * finished.
- * Note that this example only works for powers of two.
+ * Broadly, the function enqueues a matrix * matrix kernel of sycl_gemm.hpp
+ * with the given work size (see tune_block_size) on the queue provided.
+ * Because the buffers are constructed inside this function, it will block
+ * until the work is finished.
+ * The kernels handle matrices of any size: the tiles at the edges of the
+ * matrices are partially filled.
  * */
 template <typename T>
-bool local_mxm(cl::sycl::queue &q, T *MA, T *MB, T *MC, int matSize) {
-  // Make sure it is power of two before running
-  if (!isPowerOfTwo(matSize)) {
-    std::cout << " This example only works with power of two sizes "
-              << std::endl;
-    return true;
-  }
-
-  auto device = q.get_device();
-  auto maxBlockSize =
-      device.get_info<cl::sycl::info::device::max_work_group_size>();
-  auto blockSize = prevPowerOfTwo(std::sqrt(maxBlockSize));
-  std::cout << " The Device Max Work Group Size is : " << maxBlockSize
-            << std::endl;
+bool local_mxm(cl::sycl::queue &q, T *MA, T *MB, T *MC, int matSize,
+               kernel_variant variant, int blockSize) {
   std::cout << " The order is : " << matSize << std::endl;
   std::cout << " The blockSize is : " << blockSize << std::endl;
-  // Make sure the block size is not larger than the mat size
-  blockSize = std::min(matSize, blockSize);
 
   {
     range<1> dimensions(matSize * matSize);
@@ -149,63 +152,352 @@ bool local_mxm(cl::sycl::queue &q, T *MA, T *MB, T *MC, int matSize) {
     buffer<T, 1, map_allocator<T> > bB(MB, dimensions);
     buffer<T, 1, map_allocator<T> > bC(MC, dimensions);
 
-    q.submit([&](handler &cgh) {
-      auto pA = bA.template get_access<access::mode::read>(cgh);
-      auto pB = bB.template get_access<access::mode::read>(cgh);
-      auto pC = bC.template get_access<access::mode::write>(cgh);
-      auto localRange = range<1>(blockSize * blockSize);
-
-      accessor<T, 1, access::mode::read_write, access::target::local> pBA(
-          localRange, cgh);
-      accessor<T, 1, access::mode::read_write, access::target::local> pBB(
-          localRange, cgh);
-
-      cgh.parallel_for<class mxm_functor>(
-          nd_range<2>{range<2>(matSize, matSize),
-                      range<2>(blockSize, blockSize)},
-          [=](nd_item<2> it) {
-            // Current block
-            int blockX = it.get_group(0);
-            int blockY = it.get_group(1);
-
-            // Current local item
-            int localX = it.get_local(0);
-            int localY = it.get_local(1);
-
-            // Start in the A matrix
-            int a_start = matSize * blockSize * blockY;
-            // End in the b matrix
-            int a_end = a_start + matSize - 1;
-            // Start in the b matrix
-            int b_start = blockSize * blockX;
-
-            // Result for the current C(i,j) element
-            T tmp = 0.0f;
-            // We go through all a, b blocks
-            for (int a = a_start, b = b_start; a <= a_end;
-                 a += blockSize, b += (blockSize * matSize)) {
-              // Copy the values in shared memory collectively
-              pBA[localY * blockSize + localX] =
-                  pA[a + matSize * localY + localX];
-              // Note the swap of X/Y to maintain contiguous access
-              pBB[localX * blockSize + localY] =
-                  pB[b + matSize * localY + localX];
-              it.barrier(access::fence_space::local_space);
-              // Now each thread adds the value of its sum
-              for (int k = 0; k < blockSize; k++) {
-                tmp +=
-                    pBA[localY * blockSize + k] * pBB[localX * blockSize + k];
-              }
-              // The barrier ensures that all threads have written to local
-              // memory before continuing
-              it.barrier(access::fence_space::local_space);
-            }
-            auto elemIndex =
-                it.get_global(1) * it.get_global_range()[0] + it.get_global(0);
-            // Each thread updates its position
-            pC[elemIndex] = tmp;
-          });
-    });
+    run_gemm(q, variant, make_gemm_shape(matSize, matSize, matSize), T(1),
+             bA, bB, T(0), bC, blockSize);
+  }
+  return false;
+}
+
+/* Multiplies rectangular matrices, stored with padding between their rows,
+ * with every combination of transposed operands, on the device and on the
+ * host, and compares the results. The rows of A and B are padded by two
+ * elements, and then to a multiple of four elements, which the
+ * register-tiled kernel reads with vector loads.
+ * run(s, bA, bB, bC) enqueues the multiplication with the kernel to check,
+ * whose name is given by name.
+ * Returns true if there is an error. */
+template <typename RunT>
+bool check_shapes(int matSize, const std::string &name, RunT run) {
+  const int m = matSize + 3;
+  const int n = matSize / 2 + 1;
+  const int k = matSize - 5;
+  const int pad = 2;
+  std::mt19937 rng(matSize);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  bool error = false;
+  for (int t = 0; t < 8; t++) {
+    gemm_shape s = make_gemm_shape(m, n, k, t & 1, t & 2);
+    s.lda += pad;
+    s.ldb += pad;
+    s.ldc += pad;
+    if (t & 4) {
+      s.lda = (s.lda + 3) / 4 * 4;
+      s.ldb = (s.ldb + 3) / 4 * 4;
+    }
+    std::vector<float> A((s.transA ? k : m) * s.lda);
+    std::vector<float> B((s.transB ? n : k) * s.ldb);
+    std::vector<float> C(m * s.ldc);
+    for (auto &x : A) {
+      x = dist(rng);
+    }
+    for (auto &x : B) {
+      x = dist(rng);
+    }
+    for (auto &x : C) {
+      x = dist(rng);
+    }
+    std::vector<float> expected(C);
+    host_gemm(s.transA, s.transB, m, n, k, 2.0f, A.data(), s.lda, B.data(),
+              s.ldb, 0.5f, expected.data(), s.ldc);
+    {
+      buffer<float, 1> bA(A.data(), range<1>(A.size()));
+      buffer<float, 1> bB(B.data(), range<1>(B.size()));
+      buffer<float, 1> bC(C.data(), range<1>(C.size()));
+      run(s, bA, bB, bC);
+    }
+    for (int i = 0; i < m; i++) {
+      for (int j = 0; j < n; j++) {
+        float diff = std::fabs(C[i * s.ldc + j] - expected[i * s.ldc + j]);
+        if (diff > 1e-3f * std::fabs(expected[i * s.ldc + j]) + 1e-3f) {
+          std::cout << " " << name << " " << m << "x" << n
+                    << "x" << k << " (transA "
+                    << s.transA << ", transB " << s.transB << ") position "
+                    << i << ", " << j << " differs: " << C[i * s.ldc + j]
+                    << " != " << expected[i * s.ldc + j] << std::endl;
+          error = true;
+          i = m;
+          break;
+        }
+      }
+    }
+  }
+  return error;
+}
+
+/* Checks every specialization of gemm_dispatch.hpp that the device
+ * supports with check_shapes.
+ * Returns true if there is an error. */
+bool check_specializations(cl::sycl::queue &q, int matSize) {
+  const auto &table = gemm_specializations();
+  bool error = false;
+  for (std::size_t i = 0; i < table.size(); i++) {
+    if (!specialization_supported(table[i], q.get_device(), sizeof(float))) {
+      continue;
+    }
+    error = check_shapes(matSize, table[i].name,
+                         [&](const gemm_shape &s, buffer<float, 1> &bA,
+                             buffer<float, 1> &bB, buffer<float, 1> &bC) {
+                           run_specialized_gemm(q, int(i), s, 2.0f, bA, bB,
+                                                0.5f, bC);
+                         }) ||
+            error;
+  }
+  return error;
+}
+
+/* Multiplies a matrix, stored with padding between its rows, and its
+ * transpose by a vector with gemv, and compares the results with the
+ * host. Returns true if there is an error. */
+bool check_gemv(cl::sycl::queue &q, int matSize) {
+  const int rows = matSize + 3;
+  const int cols = matSize / 2 + 1;
+  const int lda = cols + 2;
+  std::mt19937 rng(matSize);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> A(rows * lda);
+  for (auto &x : A) {
+    x = dist(rng);
+  }
+  int workGroupSize = device_block_size(q) * device_block_size(q);
+  bool error = false;
+  for (bool transA : {false, true}) {
+    // op(A) is m x n
+    const int m = transA ? cols : rows;
+    const int n = transA ? rows : cols;
+    std::vector<float> x(n), y(m);
+    for (auto &v : x) {
+      v = dist(rng);
+    }
+    for (auto &v : y) {
+      v = dist(rng);
+    }
+    std::vector<float> expected(y);
+    host_gemm(transA, false, m, 1, n, 2.0f, A.data(), lda, x.data(), 1, 0.5f,
+              expected.data(), 1);
+    {
+      buffer<float, 1> bA(A.data(), range<1>(A.size()));
+      buffer<float, 1> bX(x.data(), range<1>(x.size()));
+      buffer<float, 1> bY(y.data(), range<1>(y.size()));
+      gemv(q, transA, m, n, 2.0f, bA, lda, bX, 0.5f, bY, workGroupSize);
+    }
+    for (int i = 0; i < m; i++) {
+      float diff = std::fabs(y[i] - expected[i]);
+      if (diff > 1e-3f * std::fabs(expected[i]) + 1e-3f) {
+        std::cout << " gemv " << m << "x" << n << " (transA " << transA
+                  << ") position " << i << " differs: " << y[i]
+                  << " != " << expected[i] << std::endl;
+        error = true;
+        break;
+      }
+    }
+  }
+  return error;
+}
+
+/* Multiplies rectangular matrices with every combination of transposed
+ * operands with streamed_gemm, with a memory budget for tiles of 32 x 32
+ * elements, so the matrices are split into several tiles and panels,
+ * and compares the results with the host.
+ * Returns true if there is an error. */
+bool check_streamed(cl::sycl::queue &q, int matSize) {
+  const int m = matSize + 3;
+  const int n = matSize / 2 + 1;
+  const int k = matSize + 17;
+  const std::size_t budget = 6 * 32 * 32 * sizeof(float);
+  std::mt19937 rng(matSize);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  bool error = false;
+  for (int t = 0; t < 8; t++) {
+    gemm_shape s = make_gemm_shape(m, n, k, t & 1, t & 2);
+    s.lda += 1;
+    s.ldc += 2;
+    // Half of the products overwrite C
+    const float beta = (t & 4) ? 0.0f : 0.5f;
+    std::vector<float> A((s.transA ? k : m) * s.lda);
+    std::vector<float> B((s.transB ? n : k) * s.ldb);
+    std::vector<float> C(m * s.ldc);
+    for (auto &x : A) {
+      x = dist(rng);
+    }
+    for (auto &x : B) {
+      x = dist(rng);
+    }
+    for (auto &x : C) {
+      x = dist(rng);
+    }
+    std::vector<float> expected(C);
+    host_gemm(s.transA, s.transB, m, n, k, 2.0f, A.data(), s.lda, B.data(),
+              s.ldb, beta, expected.data(), s.ldc);
+    streamed_gemm(q, s, 2.0f, A.data(), B.data(), beta, C.data(), budget);
+    for (std::size_t i = 0; i < C.size(); i++) {
+      float diff = std::fabs(C[i] - expected[i]);
+      if (diff > 1e-3f * std::fabs(expected[i]) + 1e-3f) {
+        std::cout << " streamed " << m << "x" << n << "x" << k << " (transA "
+                  << s.transA << ", transB " << s.transB << ", beta " << beta
+                  << ") element " << i << " differs: " << C[i]
+                  << " != " << expected[i] << std::endl;
+        error = true;
+        break;
+      }
+    }
+  }
+  return error;
+}
+
+/* Returns true if the device supports arithmetic on elements of type T:
+ * half and double are optional in OpenCL. */
+template <typename T>
+bool device_supports(const cl::sycl::device &d) {
+  return true;
+}
+
+template <>
+bool device_supports<cl::sycl::half>(const cl::sycl::device &d) {
+  return d.has_extension("cl_khr_fp16");
+}
+
+template <>
+bool device_supports<double>(const cl::sycl::device &d) {
+  return d.has_extension("cl_khr_fp64");
+}
+
+/* Multiplies A and B, given in double precision, with matrices of type T
+ * on the device, and compares the result with ref, the product computed
+ * in double precision on the host. Half matrices are multiplied with
+ * float sums (see gemm_accumulator). If the device does not support T,
+ * float is used instead.
+ * Prints the time, the GFLOPs and the largest error relative to the
+ * largest element of ref, and returns true if the error is more than
+ * tolerance. */
+template <typename T>
+bool run_precision(cl::sycl::queue &q, codeplay::autotuner &tuner,
+                   const std::string &name, int matSize,
+                   const std::vector<double> &A, const std::vector<double> &B,
+                   const std::vector<double> &ref, double tolerance) {
+  if (!device_supports<T>(q.get_device())) {
+    std::cout << name << ": not supported by the device, using float"
+              << std::endl;
+    return run_precision<float>(q, tuner, name + " (as float)", matSize, A,
+                                B, ref, 1e-4);
+  }
+  std::vector<T> MA(A.size());
+  std::vector<T> MB(B.size());
+  std::vector<T> MC(ref.size(), T(0));
+  for (size_t i = 0; i < A.size(); i++) {
+    MA[i] = T(A[i]);
+    MB[i] = T(B[i]);
+  }
+  auto variant = kernel_variant::register_tiled;
+  auto tuning = tune_block_size<T>(tuner, q, variant, matSize);
+  auto start = std::chrono::steady_clock::now();
+  bool error = local_mxm(q, MA.data(), MB.data(), MC.data(), matSize,
+                         variant, tuning.params[0]);
+  q.wait_and_throw();
+  std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+  double maxRef = 0.0;
+  double maxDiff = 0.0;
+  for (size_t i = 0; i < ref.size(); i++) {
+    maxRef = std::max(maxRef, std::fabs(ref[i]));
+    maxDiff = std::max(maxDiff, std::fabs(double(MC[i]) - ref[i]));
+  }
+  double relError = maxDiff / maxRef;
+  std::cout << name << " (" << sizeof(T) * 8 << "-bit storage): Time: "
+            << time.count() * 1000.0 << " ms, GFLOPs: "
+            << 2.0 * matSize * matSize * matSize / time.count() * 1.0e-9
+            << ", relative error: " << relError << std::endl;
+  return error || !(relError <= tolerance);
+}
+
+/* Multiplies random matrices in half, single and double precision, and
+ * compares the results with the product computed in double precision on
+ * the host.
+ * Returns true if there is an error. */
+bool check_precisions(cl::sycl::queue &q, codeplay::autotuner &tuner,
+                      int matSize) {
+  std::mt19937 rng(matSize);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  std::vector<double> A(matSize * matSize);
+  std::vector<double> B(matSize * matSize);
+  std::vector<double> ref(matSize * matSize, 0.0);
+  for (auto &x : A) {
+    x = dist(rng);
+  }
+  for (auto &x : B) {
+    x = dist(rng);
+  }
+  host_gemm(false, false, matSize, matSize, matSize, 1.0, A.data(), matSize,
+            B.data(), matSize, 0.0, ref.data(), matSize);
+  bool error = false;
+  // Half has an 11-bit significand, float 24 bits and double 53 bits
+  error = run_precision<cl::sycl::half>(q, tuner, "half", matSize, A, B, ref,
+                                        1e-2) ||
+          error;
+  error = run_precision<float>(q, tuner, "float", matSize, A, B, ref, 1e-4) ||
+          error;
+  error = run_precision<double>(q, tuner, "double", matSize, A, B, ref,
+                                1e-10) ||
+          error;
+  return error;
+}
+
+/* Multiplies random matrices with host_gemm and with strassen_gemm,
+ * compares the times, and checks that the difference between the two
+ * products is within the error bounds of the two algorithms.
+ * Returns true if there is an error. */
+bool check_strassen(int matSize, int threshold) {
+  int levels = strassen_levels(matSize, matSize, matSize, threshold);
+  std::cout << "Strassen-Winograd, threshold " << threshold << ": " << levels
+            << " levels" << std::endl;
+  if (levels == 0) {
+    return false;
+  }
+  std::mt19937 rng(matSize);
+  std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+  std::vector<float> A(matSize * matSize);
+  std::vector<float> B(matSize * matSize);
+  for (auto &x : A) {
+    x = dist(rng);
+  }
+  for (auto &x : B) {
+    x = dist(rng);
+  }
+  std::vector<float> classic(matSize * matSize);
+  std::vector<float> strassen(matSize * matSize);
+  strassen_workspace<float> ws;
+
+  using seconds_t = std::chrono::duration<double>;
+  auto start = std::chrono::steady_clock::now();
+  host_gemm(false, false, matSize, matSize, matSize, 1.0f, A.data(), matSize,
+            B.data(), matSize, 0.0f, classic.data(), matSize);
+  seconds_t classicTime = std::chrono::steady_clock::now() - start;
+  start = std::chrono::steady_clock::now();
+  strassen_gemm(matSize, matSize, matSize, 1.0f, A.data(), matSize, B.data(),
+                matSize, 0.0f, strassen.data(), matSize, threshold, ws);
+  seconds_t strassenTime = std::chrono::steady_clock::now() - start;
+
+  double maxA = 0.0;
+  double maxB = 0.0;
+  double maxDiff = 0.0;
+  for (int i = 0; i < matSize * matSize; i++) {
+    maxA = std::max(maxA, double(std::fabs(A[i])));
+    maxB = std::max(maxB, double(std::fabs(B[i])));
+    maxDiff = std::max(maxDiff, double(std::fabs(strassen[i] - classic[i])));
+  }
+  // The difference is bounded by the sum of the bounds of the two products
+  const double u = std::numeric_limits<float>::epsilon() / 2;
+  double error = maxDiff / (u * maxA * maxB);
+  double bound = strassen_error_bound(matSize, matSize, matSize, threshold) +
+                 double(matSize) * matSize;
+  std::cout << " Time: " << strassenTime.count() * 1000.0 << " ms ("
+            << classicTime.count() / strassenTime.count()
+            << "x host_gemm), workspace: "
+            << ws.size() * sizeof(float) / (1024 * 1024) << " MB"
+            << std::endl;
+  std::cout << " Difference with host_gemm: " << error
+            << " u max|A| max|B|, bound: " << bound << std::endl;
+  if (error > bound) {
+    std::cout << " Error in the computation " << std::endl;
+    return true;
   }
   return false;
 }
@@ -214,11 +506,15 @@ bool local_mxm(cl::sycl::queue &q, T *MA, T *MB, T *MC, int matSize) {
 void usage(std::string programName) {
   std::cout << " Incorrect number of parameters " << std::endl;
   std::cout << " Usage: " << std::endl;
-  std::cout << programName << " [matrix size] [omp|sycl]" << std::endl;
-  std::cout << "[matrix size] : Size of the matrix to multiply (minimum 32)"
+  std::cout << programName
+            << " [matrix size] [omp|sycl|both] [strassen threshold]"
             << std::endl;
-  std::cout << "[omp|sycl]    : Run the OpenMP or the SYCL variant. "
+  std::cout << "[matrix size] : Size of the matrix to multiply (minimum 8)"
+            << std::endl;
+  std::cout << "[omp|sycl|both]    : Run the OpenMP or the SYCL variant. "
             << " Default is to use both " << std::endl;
+  std::cout << "[strassen threshold] : Size below which the host Strassen"
+            << " multiplication uses host_gemm. Default is 1024 " << std::endl;
 }
 
 int main(int argc, char *argv[]) {
@@ -228,8 +524,9 @@ int main(int argc, char *argv[]) {
   bool sycl = true;
   bool omp = true;
   bool error = false;
+  int strassenThreshold = 1024;
 
-  if (argc != 2 && argc != 3) {
+  if (argc < 2 || argc > 4) {
     usage(argv[0]);
     return 1;
   }
@@ -242,19 +539,32 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
-  if (matSize < 32) {
+  if (matSize < 8) {
     usage(argv[0]);
     return 1;
   }
 
-  if (argc == 3) {
+  if (argc == 4) {
+    try {
+      strassenThreshold = std::stoi(argv[3]);
+    } catch (...) {
+      usage(argv[0]);
+      return 1;
+    }
+    if (strassenThreshold < 1) {
+      usage(argv[0]);
+      return 1;
+    }
+  }
+
+  if (argc >= 3) {
     if (std::string(argv[2]) == "omp") {
       omp = true;
       sycl = false;
     } else if (std::string(argv[2]) == "sycl") {
       omp = false;
       sycl = true;
-    } else {
+    } else if (std::string(argv[2]) != "both") {
       usage(argv[0]);
     }
   }
@@ -286,6 +596,7 @@ int main(int argc, char *argv[]) {
 #else
     std::cout << "C++: ";
 #endif
+    std::cout << "(" << host_gemm_default_kernel<float>().name << " kernel) ";
 
     {
       auto start = std::chrono::steady_clock::now();
@@ -315,6 +626,8 @@ int main(int argc, char *argv[]) {
         std::cout << " Error in the computation " << std::endl;
       }
     }
+
+    error = check_strassen(matSize, strassenThreshold) || error;
   }
 
   if (sycl) {
@@ -326,57 +639,147 @@ int main(int argc, char *argv[]) {
       }
 
     {
-      {
-        /* Create the SYCL queue - note that we add an async handler function
-         * to capture potential asynchronous errors. This function will be
-         * called every time there is an asynchronous error on the queue (i.e.
-         * some error occurs while the queue is executing kernels) and one of
-         * cl::sycl::queue::throw() or cl::sycl::queue::wait_and_throw() is
-         * called. */
-        queue q([&](exception_list eL) {
-          try {
-            for (auto &e : eL) {
-              std::rethrow_exception(e);
-            }
-          } catch (cl::sycl::exception e) {
-            std::cout << " An exception has been thrown: " << e.what()
-                      << std::endl;
+      /* Create the SYCL queue - note that we add an async handler function
+       * to capture potential asynchronous errors. This function will be
+       * called every time there is an asynchronous error on the queue (i.e.
+       * some error occurs while the queue is executing kernels) and one of
+       * cl::sycl::queue::throw() or cl::sycl::queue::wait_and_throw() is
+       * called. */
+      queue q([&](exception_list eL) {
+        try {
+          for (auto &e : eL) {
+            std::rethrow_exception(e);
           }
-        });
-
+        } catch (cl::sycl::exception e) {
+          std::cout << " An exception has been thrown: " << e.what()
+                    << std::endl;
+        }
+      });
+      std::cout << " The Device Max Work Group Size is : "
+                << q.get_device()
+                       .get_info<cl::sycl::info::device::max_work_group_size>()
+                << std::endl;
+
+      codeplay::autotuner tuner;
+      for (auto variant :
+           {kernel_variant::tiled, kernel_variant::register_tiled}) {
+        auto tuning = tune_block_size<float>(tuner, q, variant, matSize);
+        std::cout << " The " << variant_name(variant) << " kernel was "
+                  << (tuning.cached ? "tuned by a previous run" : "tuned")
+                  << " (" << tuner.path() << ")" << std::endl;
+        for (int i = 0; i < matSize * matSize; i++) {
+          MC[i] = 0.0f;
+        }
         auto start = std::chrono::steady_clock::now();
-        error = local_mxm(q, MA, MB, MC, matSize);
+        bool variantError = local_mxm(q, MA, MB, MC, matSize, variant,
+                                      tuning.params[0]);
         q.wait_and_throw();
         auto end = std::chrono::steady_clock::now();
         auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
                         end - start).count();
-        std::cout << "SYCL: ";
+        std::cout << "SYCL (" << variant_name(variant) << "): ";
         std::cout << "Time: " << time << std::endl;
         float flops =
             (2.0f * matSize * matSize * matSize / (time / 1000.0f)) * 1.0e-9f;
         std::cout << "GFLOPs: " << flops << std::endl;
         std::cout << " Output " << std::endl;
-      }
 
-      if (!error) {
-        display_matrix(MC, matSize);
-        error = false;
-        // Testing
-        for (int i = 0; i < matSize; i++)
-          for (int j = 0; j < matSize; j++) {
-            if (std::fabs(MC[i * matSize + j] - MB[i * matSize + j]) > 1e-8) {
-              std::cout << " Position " << i << ", " << j
-                        << " differs: " << MC[i * matSize + j]
-                        << " != " << MB[i * matSize + j] << std::endl;
-              error = true;
+        if (!variantError) {
+          display_matrix(MC, matSize);
+          // Testing
+          for (int i = 0; i < matSize; i++)
+            for (int j = 0; j < matSize; j++) {
+              if (std::fabs(MC[i * matSize + j] - MB[i * matSize + j]) >
+                  1e-8) {
+                std::cout << " Position " << i << ", " << j
+                          << " differs: " << MC[i * matSize + j]
+                          << " != " << MB[i * matSize + j] << std::endl;
+                variantError = true;
+              }
             }
+          variantError =
+              check_shapes(matSize, variant_name(variant),
+                           [&](const gemm_shape &s, buffer<float, 1> &bA,
+                               buffer<float, 1> &bB, buffer<float, 1> &bC) {
+                             run_gemm(q, variant, s, 2.0f, bA, bB, 0.5f, bC,
+                                      std::min(16, device_block_size(q)));
+                           }) ||
+              variantError;
+          if (!variantError) {
+            std::cout << "Success" << std::endl;
+          } else {
+            std::cout << " Error in the computation " << std::endl;
+          }
+        }
+        error = error || variantError;
+      }
+
+      std::cout << " ***** Specialized kernels " << std::endl;
+      {
+        int choice = choose_gemm_specialization<float>(tuner, q, matSize);
+        std::cout << " The dispatch table chose "
+                  << ((choice == generic_gemm)
+                          ? "the generic tiled_gemm"
+                          : gemm_specializations()[choice].name)
+                  << std::endl;
+        for (int i = 0; i < matSize * matSize; i++) {
+          MC[i] = 0.0f;
+        }
+        auto start = std::chrono::steady_clock::now();
+        {
+          range<1> dimensions(matSize * matSize);
+          buffer<float, 1, map_allocator<float> > bA(MA, dimensions);
+          buffer<float, 1, map_allocator<float> > bB(MB, dimensions);
+          buffer<float, 1, map_allocator<float> > bC(MC, dimensions);
+          run_specialized_gemm(q, choice,
+                               make_gemm_shape(matSize, matSize, matSize),
+                               1.0f, bA, bB, 0.0f, bC,
+                               std::min(16, device_block_size(q)));
+        }
+        q.wait_and_throw();
+        auto end = std::chrono::steady_clock::now();
+        auto time = std::chrono::duration_cast<std::chrono::milliseconds>(
+                        end - start).count();
+        std::cout << "SYCL (specialized): Time: " << time << std::endl;
+        bool specializedError = false;
+        for (int i = 0; i < matSize * matSize && !specializedError; i++) {
+          if (std::fabs(MC[i] - MB[i]) > 1e-8) {
+            std::cout << " Position " << i / matSize << ", " << i % matSize
+                      << " differs: " << MC[i] << " != " << MB[i]
+                      << std::endl;
+            specializedError = true;
           }
-        if (!error) {
+        }
+        specializedError =
+            check_specializations(q, matSize) || specializedError;
+        if (!specializedError) {
           std::cout << "Success" << std::endl;
-          ;
         } else {
           std::cout << " Error in the computation " << std::endl;
         }
+        error = error || specializedError;
+      }
+
+      std::cout << " ***** Matrix vector product " << std::endl;
+      if (check_gemv(q, matSize)) {
+        std::cout << " Error in the computation " << std::endl;
+        error = true;
+      } else {
+        std::cout << "Success" << std::endl;
+      }
+
+      std::cout << " ***** Streamed " << std::endl;
+      if (check_streamed(q, matSize)) {
+        std::cout << " Error in the computation " << std::endl;
+        error = true;
+      } else {
+        std::cout << "Success" << std::endl;
+      }
+
+      std::cout << " ***** Precisions " << std::endl;
+      if (check_precisions(q, tuner, matSize)) {
+        std::cout << " Error in the computation " << std::endl;
+        error = true;
       }
     }
   }
@@ -0,0 +1,322 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  strassen_gemm.hpp
+ *
+ *  Description:
+ *    Recursive Strassen-Winograd matrix multiplication on the host for
+ *    large matrices, with host_gemm at the leaves of the recursion.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_STRASSEN_GEMM_HPP
+#define INCLUDE_STRASSEN_GEMM_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "host_gemm.hpp"
+
+/* strassen_workspace
+ * Memory for the temporary matrices of strassen_gemm. It is allocated
+ * once, and the levels of the recursion take and give back their
+ * temporaries in last in, first out order, so no level allocates memory.
+ * A workspace can be reused by successive multiplications.
+ */
+template <typename T>
+class strassen_workspace {
+ public:
+  explicit strassen_workspace(std::size_t size = 0)
+      : m_data(size), m_top(0) {}
+
+  /* Makes room for size elements. Nothing must be taken. */
+  void reserve(std::size_t size) {
+    if (m_top != 0) {
+      throw std::out_of_range("A strassen_workspace is in use");
+    }
+    if (size > m_data.size()) {
+      m_data.resize(size);
+    }
+  }
+
+  /* Takes n elements from the top of the workspace */
+  T* push(std::size_t n) {
+    if (m_top + n > m_data.size()) {
+      throw std::out_of_range("The strassen_workspace is too small");
+    }
+    T* p = m_data.data() + m_top;
+    m_top += n;
+    return p;
+  }
+
+  /* Gives back the last n elements taken */
+  void pop(std::size_t n) { m_top -= n; }
+
+  std::size_t size() const { return m_data.size(); }
+
+ private:
+  std::vector<T> m_data;
+  std::size_t m_top;
+};
+
+namespace strassen_detail {
+
+/* Whether a product of the given dimensions is split in four */
+inline bool split(int m, int n, int k, int threshold) {
+  return m > threshold && n > threshold && k > threshold;
+}
+
+/* Elements of workspace used by the recursion for C = A * B */
+inline std::size_t workspace_size(int m, int n, int k, int threshold) {
+  if (!split(m, n, k, threshold)) {
+    return 0;
+  }
+  std::size_t mh = m / 2;
+  std::size_t nh = n / 2;
+  std::size_t kh = k / 2;
+  return mh * kh + kh * nh + mh * nh +
+         workspace_size(m / 2, n / 2, k / 2, threshold);
+}
+
+/* Z = X + sign * Y, for m x n matrices */
+template <typename T>
+void add(int m, int n, const T* X, int ldx, T sign, const T* Y, int ldy,
+         T* Z, int ldz) {
+#pragma omp parallel for
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      Z[i * ldz + j] = X[i * ldx + j] + sign * Y[i * ldy + j];
+    }
+  }
+}
+
+/* Sums of the products P1 (in Z), P3 (in C11), P5 (in C22), P6 (in C12)
+ * and P7 (in C21), in one pass over the quadrants instead of five:
+ * U2 = P1 + P6, U3 = U2 + P7 (in C21), U4 = U2 + P5,
+ * C22 = U3 + P5 and C12 = U4 + P3. */
+template <typename T>
+void combine(int m, int n, const T* Z, int ldz, const T* C11, T* C12,
+             T* C21, T* C22, int ldc) {
+#pragma omp parallel for
+  for (int i = 0; i < m; i++) {
+    for (int j = 0; j < n; j++) {
+      int c = i * ldc + j;
+      T u2 = Z[i * ldz + j] + C12[c];
+      T u3 = u2 + C21[c];
+      T p5 = C22[c];
+      C21[c] = u3;
+      C22[c] = u3 + p5;
+      C12[c] = u2 + p5 + C11[c];
+    }
+  }
+}
+
+template <typename T>
+void multiply(int m, int n, int k, const T* A, int lda, const T* B, int ldb,
+              T* C, int ldc, int threshold, strassen_workspace<T>& ws);
+
+/* C = A * B for even m, n and k, with the seven products of Winograd's
+ * variant of Strassen's algorithm. The schedule follows Douglas et al.
+ * (1994): the quadrants of C hold intermediate sums, so only X (the size
+ * of a quadrant of A), Y (of B) and Z (of C) are taken from the
+ * workspace. */
+template <typename T>
+void winograd(int m, int n, int k, const T* A, int lda, const T* B, int ldb,
+              T* C, int ldc, int threshold, strassen_workspace<T>& ws) {
+  const int mh = m / 2;
+  const int nh = n / 2;
+  const int kh = k / 2;
+  const T* A11 = A;
+  const T* A12 = A + kh;
+  const T* A21 = A + mh * lda;
+  const T* A22 = A21 + kh;
+  const T* B11 = B;
+  const T* B12 = B + nh;
+  const T* B21 = B + kh * ldb;
+  const T* B22 = B21 + nh;
+  T* C11 = C;
+  T* C12 = C + nh;
+  T* C21 = C + mh * ldc;
+  T* C22 = C21 + nh;
+
+  const std::size_t sizeX = std::size_t(mh) * kh;
+  const std::size_t sizeY = std::size_t(kh) * nh;
+  const std::size_t sizeZ = std::size_t(mh) * nh;
+  T* X = ws.push(sizeX);
+  T* Y = ws.push(sizeY);
+  T* Z = ws.push(sizeZ);
+  const T one(1);
+
+  // P7 = (A11 - A21) * (B22 - B12) in C21
+  add(mh, kh, A11, lda, -one, A21, lda, X, kh);
+  add(kh, nh, B22, ldb, -one, B12, ldb, Y, nh);
+  multiply(mh, nh, kh, X, kh, Y, nh, C21, ldc, threshold, ws);
+  // P5 = (A21 + A22) * (B12 - B11) in C22
+  add(mh, kh, A21, lda, one, A22, lda, X, kh);
+  add(kh, nh, B12, ldb, -one, B11, ldb, Y, nh);
+  multiply(mh, nh, kh, X, kh, Y, nh, C22, ldc, threshold, ws);
+  // P6 = (A21 + A22 - A11) * (B22 - B12 + B11) in C12
+  add(mh, kh, X, kh, -one, A11, lda, X, kh);
+  add(kh, nh, B22, ldb, -one, Y, nh, Y, nh);
+  multiply(mh, nh, kh, X, kh, Y, nh, C12, ldc, threshold, ws);
+  // P3 = (A12 - A21 - A22 + A11) * B22 in C11
+  add(mh, kh, A12, lda, -one, X, kh, X, kh);
+  multiply(mh, nh, kh, X, kh, B22, ldb, C11, ldc, threshold, ws);
+  // P1 = A11 * B11 in Z
+  multiply(mh, nh, kh, A11, lda, B11, ldb, Z, nh, threshold, ws);
+  // C12 and C22 are final, and C21 holds U3
+  combine(mh, nh, Z, nh, C11, C12, C21, C22, ldc);
+  // P4 = A22 * (B22 - B12 + B11 - B21) in C11, C21 = U3 - P4
+  add(kh, nh, Y, nh, -one, B21, ldb, Y, nh);
+  multiply(mh, nh, kh, A22, lda, Y, nh, C11, ldc, threshold, ws);
+  add(mh, nh, C21, ldc, -one, C11, ldc, C21, ldc);
+  // C11 = P2 + P1, with P2 = A12 * B21
+  multiply(mh, nh, kh, A12, lda, B21, ldb, C11, ldc, threshold, ws);
+  add(mh, nh, C11, ldc, one, Z, nh, C11, ldc);
+
+  ws.pop(sizeX + sizeY + sizeZ);
+}
+
+/* C = A * B. Odd dimensions are split into an even part, multiplied with
+ * winograd, and a last row, column or rank one update, multiplied with
+ * host_gemm. */
+template <typename T>
+void multiply(int m, int n, int k, const T* A, int lda, const T* B, int ldb,
+              T* C, int ldc, int threshold, strassen_workspace<T>& ws) {
+  const T one(1);
+  const T zero(0);
+  if (!split(m, n, k, threshold)) {
+    host_gemm(false, false, m, n, k, one, A, lda, B, ldb, zero, C, ldc);
+    return;
+  }
+  const int m2 = m & ~1;
+  const int n2 = n & ~1;
+  const int k2 = k & ~1;
+  winograd(m2, n2, k2, A, lda, B, ldb, C, ldc, threshold, ws);
+  if (k2 < k) {
+    host_gemm(false, false, m2, n2, 1, one, A + k2, lda, B + k2 * ldb, ldb,
+              one, C, ldc);
+  }
+  if (n2 < n) {
+    host_gemm(false, false, m2, 1, k, one, A, lda, B + n2, ldb, zero, C + n2,
+              ldc);
+  }
+  if (m2 < m) {
+    host_gemm(false, false, 1, n, k, one, A + m2 * lda, lda, B, ldb, zero,
+              C + m2 * ldc, ldc);
+  }
+}
+
+}  // namespace strassen_detail
+
+/* strassen_levels.
+ * Number of levels of recursion of strassen_gemm for the dimensions.
+ */
+inline int strassen_levels(int M, int N, int K, int threshold) {
+  int levels = 0;
+  while (strassen_detail::split(M, N, K, threshold)) {
+    M /= 2;
+    N /= 2;
+    K /= 2;
+    levels++;
+  }
+  return levels;
+}
+
+/* strassen_error_bound.
+ * Bound of max |C - computed C| / (u * max |A| * max |B|) for the product
+ * computed by strassen_gemm, where u is the unit roundoff of the type.
+ * For l levels of Winograd's variant over leaves of size n0 it is
+ * (n0^2 + 6 n0) 18^l - 6 n, to first order in u (Higham, Accuracy and
+ * Stability of Numerical Algorithms, 2002, section 23.2.2), with n and
+ * n0 the largest dimension of the product and of the leaves. With no
+ * levels it is n^2, the bound of the classic multiplication.
+ * The bound grows much faster than the one of the classic algorithm,
+ * which is why the recursion stops at a threshold.
+ */
+inline double strassen_error_bound(int M, int N, int K, int threshold) {
+  int levels = strassen_levels(M, N, K, threshold);
+  double n = std::max(M, std::max(N, K));
+  double n0 = std::ceil(n / std::pow(2.0, levels));
+  if (levels == 0) {
+    return n * n;
+  }
+  return (n0 * n0 + 6 * n0) * std::pow(18.0, levels) - 6 * n;
+}
+
+/* strassen_gemm.
+ * Computes C = alpha * A * B + beta * C, where A is M x K, B is K x N and
+ * C is M x N, row-major with leading dimensions lda, ldb and ldc.
+ * While the three dimensions are larger than threshold, the product is
+ * split in quadrants and computed with seven products of half the size
+ * instead of eight, with Winograd's variant of Strassen's algorithm.
+ * The products of size threshold or less are computed with host_gemm.
+ * Each level does 7/8 of the arithmetic of the level above plus
+ * additions of whole matrices, so it is faster when the leaves are large
+ * enough for host_gemm to run close to its peak.
+ * The temporaries come from ws, which is enlarged if needed before the
+ * recursion starts. The error is bounded by strassen_error_bound.
+ */
+template <typename T>
+void strassen_gemm(int M, int N, int K, T alpha, const T* A, int lda,
+                   const T* B, int ldb, T beta, T* C, int ldc, int threshold,
+                   strassen_workspace<T>& ws) {
+  if (threshold < 1) {
+    throw std::out_of_range("The Strassen threshold must be positive");
+  }
+  if (M <= 0 || N <= 0) {
+    return;
+  }
+  std::size_t size = strassen_detail::workspace_size(M, N, K, threshold);
+  if (alpha == T(1) && beta == T(0)) {
+    ws.reserve(size);
+    strassen_detail::multiply(M, N, K, A, lda, B, ldb, C, ldc, threshold,
+                              ws);
+    return;
+  }
+  // The product goes through the workspace before it is scaled
+  const std::size_t sizeP = std::size_t(M) * N;
+  ws.reserve(size + sizeP);
+  T* P = ws.push(sizeP);
+  strassen_detail::multiply(M, N, K, A, lda, B, ldb, P, N, threshold, ws);
+  for (int i = 0; i < M; i++) {
+    for (int j = 0; j < N; j++) {
+      T c = (beta == T(0)) ? T(0) : beta * C[i * ldc + j];
+      C[i * ldc + j] = alpha * P[i * N + j] + c;
+    }
+  }
+  ws.pop(sizeP);
+}
+
+/* strassen_gemm.
+ * strassen_gemm with a workspace for this multiplication only.
+ */
+template <typename T>
+void strassen_gemm(int M, int N, int K, T alpha, const T* A, int lda,
+                   const T* B, int ldb, T beta, T* C, int ldc,
+                   int threshold) {
+  strassen_workspace<T> ws;
+  strassen_gemm(M, N, K, alpha, A, lda, B, ldb, beta, C, ldc, threshold, ws);
+}
+
+#endif  // INCLUDE_STRASSEN_GEMM_HPP
@@ -0,0 +1,265 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  streamed_gemm.hpp
+ *
+ *  Description:
+ *    Matrix multiplication of matrices in host memory that do not fit in
+ *    the memory of the device, streamed to the device by blocks.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_STREAMED_GEMM_HPP
+#define INCLUDE_STREAMED_GEMM_HPP
+
+#include <CL/sycl.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "sycl_gemm.hpp"
+
+/* streamed_gemm_tiles
+ * Sizes of the blocks that streamed_gemm moves to the device: C is
+ * computed by tiles of m x n elements, and each tile is accumulated over
+ * panels of op(A) of m x k elements and panels of op(B) of k x n elements.
+ */
+struct streamed_gemm_tiles {
+  int m;
+  int n;
+  int k;
+};
+
+/* streamed_gemm_footprint.
+ * Bytes of device memory used by streamed_gemm with the tiles: two of
+ * each block, so one can be transferred while the other is used.
+ */
+inline std::size_t streamed_gemm_footprint(const streamed_gemm_tiles& t,
+                                           std::size_t elemSize) {
+  return 2 * elemSize *
+         (std::size_t(t.m) * t.k + std::size_t(t.k) * t.n +
+          std::size_t(t.m) * t.n);
+}
+
+/* choose_streamed_tiles.
+ * Largest square tiles of C, in multiples of 16 elements, whose blocks
+ * fit in budgetBytes of device memory, and whose buffers are at most
+ * maxAllocBytes. The rest of the budget makes the panels longer along K,
+ * so each tile of C is moved fewer times. The tiles are no larger than
+ * the matrices.
+ * Throws std::out_of_range if the budget cannot hold a tile.
+ */
+inline streamed_gemm_tiles choose_streamed_tiles(const gemm_shape& s,
+                                                 std::size_t budgetBytes,
+                                                 std::size_t maxAllocBytes,
+                                                 std::size_t elemSize) {
+  const std::size_t elems = budgetBytes / elemSize;
+  const std::size_t maxElems = maxAllocBytes / elemSize;
+  auto side = static_cast<std::size_t>(std::sqrt(double(elems) / 6.0));
+  side = std::min<std::size_t>(
+      side, static_cast<std::size_t>(std::sqrt(double(maxElems))));
+  if (side >= 16) {
+    side -= side % 16;
+  }
+  if (side == 0) {
+    throw std::out_of_range("The memory budget is too small for a GEMM");
+  }
+  streamed_gemm_tiles t;
+  t.m = int(std::min<std::size_t>(side, s.m));
+  t.n = int(std::min<std::size_t>(side, s.n));
+  std::size_t k = (elems / 2 - std::size_t(t.m) * t.n) / (t.m + t.n);
+  k = std::min(k, maxElems / std::max(t.m, t.n));
+  if (k >= 16) {
+    k -= k % 16;
+  }
+  t.k = int(std::min<std::size_t>(k, s.k));
+  return t;
+}
+
+namespace streamed_detail {
+
+/* Copies a rows x cols block between matrices with rows lds and ldd
+ * elements long */
+template <typename T>
+void copy_block(int rows, int cols, const T* src, int lds, T* dst, int ldd) {
+  for (int i = 0; i < rows; i++) {
+    std::copy(src + std::size_t(i) * lds, src + std::size_t(i) * lds + cols,
+              dst + std::size_t(i) * ldd);
+  }
+}
+
+/* Copies count elements from host memory to the start of a buffer */
+template <typename T>
+cl::sycl::event upload(cl::sycl::queue& q, const T* src,
+                       cl::sycl::buffer<T, 1>& dst, std::size_t count) {
+  using namespace cl::sycl;
+  return q.submit([&](handler& cgh) {
+    cgh.copy(src, dst.template get_access<access::mode::discard_write>(
+                      cgh, range<1>(count), id<1>(0)));
+  });
+}
+
+/* Copies the first count elements of a buffer to host memory */
+template <typename T>
+cl::sycl::event download(cl::sycl::queue& q, cl::sycl::buffer<T, 1>& src,
+                         T* dst, std::size_t count) {
+  using namespace cl::sycl;
+  return q.submit([&](handler& cgh) {
+    cgh.copy(src.template get_access<access::mode::read>(
+                 cgh, range<1>(count), id<1>(0)),
+             dst);
+  });
+}
+
+}  // namespace streamed_detail
+
+/* streamed_gemm.
+ * Computes C = alpha * op(A) * op(B) + beta * C on the queue, for the
+ * matrices of the shape s in host memory, using at most budgetBytes of
+ * device memory (see choose_streamed_tiles), so the matrices can be much
+ * larger than the memory of the device or its largest allocation.
+ *
+ * C is computed tile by tile. A tile of C is uploaded once, unless beta
+ * is zero, the panels of op(A) and op(B) along K are multiplied into it
+ * in place by the register-tiled kernel, and it is downloaded once.
+ * There are two buffers of each kind on the device, used in turn: the
+ * panels are copied to one while the kernel reads the other, and a tile
+ * of C is computed while the previous one is downloaded. The runtime
+ * orders the commands by the buffers they use, so the copies and the
+ * kernels overlap when the device can do both at the same time.
+ * The blocks go through host staging memory, also doubled, where they are
+ * packed without the padding of the matrices, so the copies are
+ * contiguous. The host packs the next panels while the device works on
+ * the current ones, and only waits for the copy that last used the
+ * staging memory it reuses.
+ * Returns when C is written.
+ */
+template <typename T>
+void streamed_gemm(cl::sycl::queue& q, const gemm_shape& s, T alpha,
+                   const T* A, const T* B, T beta, T* C,
+                   std::size_t budgetBytes) {
+  using namespace cl::sycl;
+  using streamed_detail::copy_block;
+  sycl_gemm_detail::check_shape(
+      s, std::size_t(s.transA ? s.k : s.m) * s.lda,
+      std::size_t(s.transB ? s.n : s.k) * s.ldb, std::size_t(s.m) * s.ldc);
+  const streamed_gemm_tiles t = choose_streamed_tiles(
+      s, budgetBytes,
+      q.get_device().get_info<info::device::max_mem_alloc_size>(),
+      sizeof(T));
+  const std::size_t sizeA = std::size_t(t.m) * t.k;
+  const std::size_t sizeB = std::size_t(t.k) * t.n;
+  const std::size_t sizeC = std::size_t(t.m) * t.n;
+  const int blockSize = std::min(16, device_block_size(q));
+
+  std::vector<buffer<T, 1>> dA, dB, dC;
+  std::vector<std::vector<T>> hA, hB, hC;
+  for (int slot = 0; slot < 2; slot++) {
+    dA.push_back(buffer<T, 1>(range<1>(sizeA)));
+    dB.push_back(buffer<T, 1>(range<1>(sizeB)));
+    dC.push_back(buffer<T, 1>(range<1>(sizeC)));
+    hA.push_back(std::vector<T>(sizeA));
+    hB.push_back(std::vector<T>(sizeB));
+    hC.push_back(std::vector<T>(sizeC));
+  }
+  // Copies that read the staging memory of the panels
+  event uploadA[2];
+  event uploadB[2];
+
+  // Tile of C that is being downloaded
+  struct pending_tile {
+    int row;
+    int col;
+    int rows;
+    int cols;
+    int slot;
+    event download;
+  };
+  auto finish = [&](pending_tile& p) {
+    p.download.wait();
+    copy_block(p.rows, p.cols, hC[p.slot].data(), p.cols,
+               C + std::size_t(p.row) * s.ldc + p.col, s.ldc);
+  };
+
+  pending_tile previous{0, 0, 0, 0, 0, event()};
+  bool hasPrevious = false;
+  int tile = 0;
+  int panel = 0;
+  for (int i0 = 0; i0 < s.m; i0 += t.m) {
+    for (int j0 = 0; j0 < s.n; j0 += t.n, tile++) {
+      const int mt = std::min(t.m, s.m - i0);
+      const int nt = std::min(t.n, s.n - j0);
+      const int slot = tile & 1;
+      if (beta != T(0)) {
+        copy_block(mt, nt, C + std::size_t(i0) * s.ldc + j0, s.ldc,
+                   hC[slot].data(), nt);
+        streamed_detail::upload(q, hC[slot].data(), dC[slot],
+                                std::size_t(mt) * nt);
+      }
+      for (int p0 = 0; p0 < s.k; p0 += t.k, panel++) {
+        const int kt = std::min(t.k, s.k - p0);
+        const int ps = panel & 1;
+        uploadA[ps].wait();
+        uploadB[ps].wait();
+        // The panels keep the layout of A and B
+        if (!s.transA) {
+          copy_block(mt, kt, A + std::size_t(i0) * s.lda + p0, s.lda,
+                     hA[ps].data(), kt);
+        } else {
+          copy_block(kt, mt, A + std::size_t(p0) * s.lda + i0, s.lda,
+                     hA[ps].data(), mt);
+        }
+        if (!s.transB) {
+          copy_block(kt, nt, B + std::size_t(p0) * s.ldb + j0, s.ldb,
+                     hB[ps].data(), nt);
+        } else {
+          copy_block(nt, kt, B + std::size_t(j0) * s.ldb + p0, s.ldb,
+                     hB[ps].data(), kt);
+        }
+        uploadA[ps] = streamed_detail::upload(q, hA[ps].data(), dA[ps],
+                                              std::size_t(mt) * kt);
+        uploadB[ps] = streamed_detail::upload(q, hB[ps].data(), dB[ps],
+                                              std::size_t(kt) * nt);
+        gemm_shape panelShape = {mt, nt, kt, s.transA, s.transB,
+                                 s.transA ? mt : kt, s.transB ? kt : nt, nt};
+        run_gemm(q, kernel_variant::register_tiled, panelShape, alpha,
+                 dA[ps], dB[ps], (p0 == 0) ? beta : T(1), dC[slot],
+                 blockSize);
+      }
+      pending_tile current{i0, j0, mt, nt, slot,
+                           streamed_detail::download(q, dC[slot],
+                                                     hC[slot].data(),
+                                                     std::size_t(mt) * nt)};
+      // The previous tile is unpacked while the device computes this one
+      if (hasPrevious) {
+        finish(previous);
+      }
+      previous = current;
+      hasPrevious = true;
+    }
+  }
+  finish(previous);
+  q.wait_and_throw();
+}
+
+#endif  // INCLUDE_STREAMED_GEMM_HPP
@@ -0,0 +1,981 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  sycl_gemm.hpp
+ *
+ *  Description:
+ *    Matrix multiplication kernels in SYCL for matrices of any shape and
+ *    layout.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_SYCL_GEMM_HPP
+#define INCLUDE_SYCL_GEMM_HPP
+
+#include <CL/sycl.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <stdexcept>
+#include <vector>
+
+/* gemm_shape
+ * Shape and layout of C = alpha * op(A) * op(B) + beta * C, for row-major
+ * matrices stored in one-dimensional buffers. op(A) is m x k, op(B) is
+ * k x n and C is m x n, where op(X) is X, or X transposed when transX is
+ * set. lda, ldb and ldc are the number of elements between two rows of
+ * A, B and C as they are stored.
+ */
+struct gemm_shape {
+  int m;
+  int n;
+  int k;
+  bool transA;
+  bool transB;
+  int lda;
+  int ldb;
+  int ldc;
+};
+
+/* make_gemm_shape.
+ * Shape of a multiplication of matrices stored without padding.
+ */
+inline gemm_shape make_gemm_shape(int m, int n, int k, bool transA = false,
+                                  bool transB = false) {
+  return gemm_shape{m, n, k, transA, transB, transA ? m : k,
+                    transB ? k : n, n};
+}
+
+namespace sycl_gemm_detail {
+
+inline int round_up(int x, int multiple) {
+  return ((x + multiple - 1) / multiple) * multiple;
+}
+
+/* check_shape.
+ * Throws std::out_of_range if the buffers are too small for the shape.
+ */
+inline void check_shape(const gemm_shape& s, std::size_t sizeA,
+                        std::size_t sizeB, std::size_t sizeC) {
+  if (s.m <= 0 || s.n <= 0 || s.k <= 0) {
+    throw std::out_of_range("The dimensions of a GEMM must be positive");
+  }
+  int rowsA = s.transA ? s.k : s.m;
+  int colsA = s.transA ? s.m : s.k;
+  int rowsB = s.transB ? s.n : s.k;
+  int colsB = s.transB ? s.k : s.n;
+  if (s.lda < colsA || s.ldb < colsB || s.ldc < s.n) {
+    throw std::out_of_range("A leading dimension is smaller than a row");
+  }
+  if (std::size_t(rowsA - 1) * s.lda + colsA > sizeA ||
+      std::size_t(rowsB - 1) * s.ldb + colsB > sizeB ||
+      std::size_t(s.m - 1) * s.ldc + s.n > sizeC) {
+    throw std::out_of_range("A buffer is too small for the GEMM shape");
+  }
+}
+
+}  // namespace sycl_gemm_detail
+
+/* gemm_accumulator
+ * Type in which the kernels sum the products of elements of type T. Half
+ * matrices are multiplied in float, so storing them in half precision
+ * halves the memory and the traffic to it, but not the precision of the
+ * sums.
+ */
+template <typename T>
+struct gemm_accumulator {
+  using type = T;
+};
+
+template <>
+struct gemm_accumulator<cl::sycl::half> {
+  using type = float;
+};
+
+/* The kernel names include the allocators of the buffers, since the
+ * accessors captured by the kernel, and so the kernel, depend on them */
+template <typename T, int TS, typename AllocA, typename AllocB,
+          typename AllocC>
+class tiled_gemm_kernel;
+
+/* tiled_gemm.
+ * Computes C = alpha * op(A) * op(B) + beta * C on the queue.
+ * Each work-group computes a tileSize x tileSize tile of C, and each
+ * work-item one element of it. The work-group goes through op(A) and
+ * op(B) in square tiles that are copied to local memory, where every
+ * element is used by tileSize work-items.
+ *
+ * Any shape is supported: the nd_range is rounded up to whole tiles, the
+ * elements of the tiles that are outside of A and B are set to zero, and
+ * the work-items outside of C do not write. For every layout, adjacent
+ * work-items in dimension 0 load adjacent elements of memory, and the
+ * rows of the tiles in local memory are padded by one element, so that
+ * the transposed writes and the reads of the tiles do not conflict on
+ * the banks of local memory.
+ * When beta is zero, C is not read.
+ *
+ * When TS is not zero, the kernel is compiled for tiles of TS x TS, and
+ * tileSize must be TS: the loop over a tile and the offsets in the tiles
+ * are then constants, so the compiler can unroll the loop. Otherwise the
+ * tile size is only known when the kernel runs.
+ */
+template <int TS = 0, typename T, typename AllocA, typename AllocB,
+          typename AllocC>
+cl::sycl::event tiled_gemm(cl::sycl::queue& q, const gemm_shape& s, T alpha,
+                           cl::sycl::buffer<T, 1, AllocA>& bA,
+                           cl::sycl::buffer<T, 1, AllocB>& bB, T beta,
+                           cl::sycl::buffer<T, 1, AllocC>& bC,
+                           int tileSize = TS) {
+  using namespace cl::sycl;
+  if (tileSize <= 0 || (TS != 0 && tileSize != TS)) {
+    throw std::out_of_range("The tile size of tiled_gemm is not valid");
+  }
+  sycl_gemm_detail::check_shape(s, bA.get_count(), bB.get_count(),
+                                bC.get_count());
+  return q.submit([&](handler& cgh) {
+    auto pA = bA.template get_access<access::mode::read>(cgh);
+    auto pB = bB.template get_access<access::mode::read>(cgh);
+    auto pC = bC.template get_access<access::mode::read_write>(cgh);
+
+    const int runTimeTs = tileSize;
+    accessor<T, 1, access::mode::read_write, access::target::local> tA(
+        range<1>(tileSize * (tileSize + 1)), cgh);
+    accessor<T, 1, access::mode::read_write, access::target::local> tB(
+        range<1>(tileSize * (tileSize + 1)), cgh);
+
+    const int m = s.m;
+    const int n = s.n;
+    const int k = s.k;
+    const bool transA = s.transA;
+    const bool transB = s.transB;
+    const int lda = s.lda;
+    const int ldb = s.ldb;
+    const int ldc = s.ldc;
+    using acc_t = typename gemm_accumulator<T>::type;
+    const acc_t alphaAcc = alpha;
+    const acc_t betaAcc = beta;
+
+    // Dimension 0 goes along the columns of C, dimension 1 along its rows
+    range<2> global(sycl_gemm_detail::round_up(n, tileSize),
+                    sycl_gemm_detail::round_up(m, tileSize));
+    cgh.parallel_for<tiled_gemm_kernel<T, TS, AllocA, AllocB, AllocC>>(
+        nd_range<2>(global, range<2>(tileSize, tileSize)),
+        [=](nd_item<2> it) {
+          // Constants in the kernels compiled for a tile size
+          const int ts = (TS != 0) ? TS : runTimeTs;
+          const int stride = ts + 1;
+          int lx = it.get_local(0);
+          int ly = it.get_local(1);
+          int col0 = it.get_group(0) * ts;
+          int row0 = it.get_group(1) * ts;
+
+          acc_t acc = acc_t(0);
+          for (int k0 = 0; k0 < k; k0 += ts) {
+            // The tile of op(A) is stored row by row, tA[i][p]
+            if (!transA) {
+              int i = row0 + ly;
+              int p = k0 + lx;
+              tA[ly * stride + lx] =
+                  (i < m && p < k) ? pA[i * lda + p] : T(0);
+            } else {
+              int i = row0 + lx;
+              int p = k0 + ly;
+              tA[lx * stride + ly] =
+                  (i < m && p < k) ? pA[p * lda + i] : T(0);
+            }
+            // The tile of op(B) is stored column by column, tB[j][p]
+            if (!transB) {
+              int p = k0 + ly;
+              int j = col0 + lx;
+              tB[lx * stride + ly] =
+                  (p < k && j < n) ? pB[p * ldb + j] : T(0);
+            } else {
+              int p = k0 + lx;
+              int j = col0 + ly;
+              tB[ly * stride + lx] =
+                  (p < k && j < n) ? pB[j * ldb + p] : T(0);
+            }
+            it.barrier(access::fence_space::local_space);
+            for (int p = 0; p < ts; p++) {
+              acc += acc_t(tA[ly * stride + p]) * acc_t(tB[lx * stride + p]);
+            }
+            it.barrier(access::fence_space::local_space);
+          }
+
+          int row = row0 + ly;
+          int col = col0 + lx;
+          if (row < m && col < n) {
+            int index = row * ldc + col;
+            pC[index] = T((betaAcc == acc_t(0))
+                              ? alphaAcc * acc
+                              : alphaAcc * acc + betaAcc * acc_t(pC[index]));
+          }
+        });
+  });
+}
+
+template <typename T, int RM, int RN, int WG, int BK, typename AllocA,
+          typename AllocB, typename AllocC>
+class register_tiled_gemm_kernel;
+
+/* register_tiled_gemm.
+ * Computes C = alpha * op(A) * op(B) + beta * C on the queue, with a
+ * kernel that does more arithmetic per access to local memory than
+ * tiled_gemm.
+ * The work-groups are WG x WG work-items, and each work-item computes an
+ * RM x RN micro-tile of C in private memory, so a work-group computes a
+ * (RM * WG) x (RN * WG) tile of C. Every element of A and B read from
+ * local memory is used RN or RM times from registers.
+ * The rows of the micro-tile are WG rows apart, and its columns WG
+ * columns apart, so that adjacent work-items read adjacent elements of
+ * the tiles in local memory and write adjacent elements of C.
+ *
+ * The tiles of op(A) and op(B) along K are BK wide, and there are two of
+ * each in local memory: while the work-group computes on one, the next
+ * one is loaded from global memory into registers, and then stored in the
+ * other one, so there is one barrier per tile instead of two.
+ * Global memory is read with vec<T, 4> loads when the rows of A and B
+ * are multiples of 4 elements, except for the tiles on the edges of the
+ * matrices, which are read element by element with bounds checks.
+ *
+ * The tiles are read along the rows of A and B as they are stored,
+ * whether they are transposed or not, so adjacent work-items always load
+ * adjacent vectors. The layout only changes where the vectors are stored
+ * in local memory: the tiles are kept K-major, and the stores transpose
+ * the vectors of A when it is not transposed, and those of B when it is.
+ */
+template <int RM, int RN, int WG = 16, int BK = 16, typename T,
+          typename AllocA, typename AllocB, typename AllocC>
+cl::sycl::event register_tiled_gemm(cl::sycl::queue& q, const gemm_shape& s,
+                                    T alpha,
+                                    cl::sycl::buffer<T, 1, AllocA>& bA,
+                                    cl::sycl::buffer<T, 1, AllocB>& bB,
+                                    T beta,
+                                    cl::sycl::buffer<T, 1, AllocC>& bC) {
+  using namespace cl::sycl;
+  // Rows and columns of C computed by a work-group
+  const int BM = RM * WG;
+  const int BN = RN * WG;
+  // Vectors of 4 elements of the tiles of A and B loaded by a work-item
+  const int VA = (BM * BK) / (4 * WG * WG);
+  const int VB = (BK * BN) / (4 * WG * WG);
+  static_assert(BK % 4 == 0 && BM % 4 == 0 && BN % 4 == 0 &&
+                    (BM * BK) % (4 * WG * WG) == 0 &&
+                    (BK * BN) % (4 * WG * WG) == 0,
+                "Each work-item must load whole vectors of the tiles");
+  sycl_gemm_detail::check_shape(s, bA.get_count(), bB.get_count(),
+                                bC.get_count());
+  return q.submit([&](handler& cgh) {
+    auto pA = bA.template get_access<access::mode::read>(cgh);
+    auto pB = bB.template get_access<access::mode::read>(cgh);
+    auto pC = bC.template get_access<access::mode::read_write>(cgh);
+
+    // The tiles are stored K-major, tA[p][i] and tB[p][j], with a padding
+    // element per row so the transposing stores do not conflict on the
+    // banks
+    const int strideA = BM + 1;
+    const int strideB = BN + 1;
+    accessor<T, 1, access::mode::read_write, access::target::local> tA(
+        range<1>(2 * BK * strideA), cgh);
+    accessor<T, 1, access::mode::read_write, access::target::local> tB(
+        range<1>(2 * BK * strideB), cgh);
+
+    const int m = s.m;
+    const int n = s.n;
+    const int k = s.k;
+    const bool transA = s.transA;
+    const bool transB = s.transB;
+    const int lda = s.lda;
+    const int ldb = s.ldb;
+    const int ldc = s.ldc;
+    using acc_t = typename gemm_accumulator<T>::type;
+    const acc_t alphaAcc = alpha;
+    const acc_t betaAcc = beta;
+    const bool vectorA = (lda % 4) == 0;
+    const bool vectorB = (ldb % 4) == 0;
+
+    range<2> global(sycl_gemm_detail::round_up(n, BN) / RN,
+                    sycl_gemm_detail::round_up(m, BM) / RM);
+    cgh.parallel_for<
+        register_tiled_gemm_kernel<T, RM, RN, WG, BK, AllocA, AllocB, AllocC>>(
+        nd_range<2>(global, range<2>(WG, WG)), [=](nd_item<2> it) {
+          const int tx = it.get_local(0);
+          const int ty = it.get_local(1);
+          const int lid = ty * WG + tx;
+          const int row0 = it.get_group(1) * BM;
+          const int col0 = it.get_group(0) * BN;
+
+          vec<T, 4> nextA[VA];
+          vec<T, 4> nextB[VB];
+
+          // Loads the tiles at k0 from global memory to registers. The
+          // tile of A is BM x BK elements of A, or BK x BM of A transposed,
+          // and vector v of a work-item starts at element e of the tile as
+          // it is stored. The tile of B is BK x BN, or BN x BK.
+          auto load = [&](int k0) {
+            const int rowsA = transA ? k : m;
+            const int colsA = transA ? m : k;
+            for (int v = 0; v < VA; v++) {
+              int e = (lid + v * WG * WG) * 4;
+              int row = transA ? k0 + e / BM : row0 + e / BK;
+              int col = transA ? row0 + e % BM : k0 + e % BK;
+              if (vectorA && row < rowsA && col + 3 < colsA) {
+                nextA[v].load((row * lda + col) / 4, pA.get_pointer());
+              } else {
+                for (int c = 0; c < 4; c++) {
+                  nextA[v][c] = (row < rowsA && col + c < colsA)
+                                    ? pA[row * lda + col + c]
+                                    : T(0);
+                }
+              }
+            }
+            const int rowsB = transB ? n : k;
+            const int colsB = transB ? k : n;
+            for (int v = 0; v < VB; v++) {
+              int e = (lid + v * WG * WG) * 4;
+              int row = transB ? col0 + e / BK : k0 + e / BN;
+              int col = transB ? k0 + e % BK : col0 + e % BN;
+              if (vectorB && row < rowsB && col + 3 < colsB) {
+                nextB[v].load((row * ldb + col) / 4, pB.get_pointer());
+              } else {
+                for (int c = 0; c < 4; c++) {
+                  nextB[v][c] = (row < rowsB && col + c < colsB)
+                                    ? pB[row * ldb + col + c]
+                                    : T(0);
+                }
+              }
+            }
+          };
+
+          // Stores the registers in the local tiles of the given buffer
+          auto store = [&](int buf) {
+            for (int v = 0; v < VA; v++) {
+              int e = (lid + v * WG * WG) * 4;
+              for (int c = 0; c < 4; c++) {
+                int index = transA
+                                ? (buf * BK + e / BM) * strideA + e % BM + c
+                                : (buf * BK + e % BK + c) * strideA + e / BK;
+                tA[index] = nextA[v][c];
+              }
+            }
+            for (int v = 0; v < VB; v++) {
+              int e = (lid + v * WG * WG) * 4;
+              for (int c = 0; c < 4; c++) {
+                int index = transB
+                                ? (buf * BK + e % BK + c) * strideB + e / BK
+                                : (buf * BK + e / BN) * strideB + e % BN + c;
+                tB[index] = nextB[v][c];
+              }
+            }
+          };
+
+          acc_t acc[RM][RN];
+          for (int i = 0; i < RM; i++) {
+            for (int j = 0; j < RN; j++) {
+              acc[i][j] = acc_t(0);
+            }
+          }
+
+          const int numTiles = (k + BK - 1) / BK;
+          load(0);
+          store(0);
+          it.barrier(access::fence_space::local_space);
+          for (int t = 0; t < numTiles; t++) {
+            const int buf = t & 1;
+            if (t + 1 < numTiles) {
+              load((t + 1) * BK);
+            }
+            for (int p = 0; p < BK; p++) {
+              acc_t a[RM];
+              acc_t b[RN];
+              for (int i = 0; i < RM; i++) {
+                a[i] = tA[(buf * BK + p) * strideA + ty + i * WG];
+              }
+              for (int j = 0; j < RN; j++) {
+                b[j] = tB[(buf * BK + p) * strideB + tx + j * WG];
+              }
+              for (int i = 0; i < RM; i++) {
+                for (int j = 0; j < RN; j++) {
+                  acc[i][j] += a[i] * b[j];
+                }
+              }
+            }
+            if (t + 1 < numTiles) {
+              store(buf ^ 1);
+            }
+            it.barrier(access::fence_space::local_space);
+          }
+
+          for (int i = 0; i < RM; i++) {
+            int row = row0 + ty + i * WG;
+            for (int j = 0; j < RN; j++) {
+              int col = col0 + tx + j * WG;
+              if (row < m && col < n) {
+                int index = row * ldc + col;
+                pC[index] = T((betaAcc == acc_t(0))
+                                  ? alphaAcc * acc[i][j]
+                                  : alphaAcc * acc[i][j] +
+                                        betaAcc * acc_t(pC[index]));
+              }
+            }
+          }
+        });
+  });
+}
+
+/* Kernels of this file that compute a single multiplication. */
+enum class kernel_variant { tiled, register_tiled };
+
+inline const char* variant_name(kernel_variant variant) {
+  return (variant == kernel_variant::tiled) ? "tiled" : "register tiled";
+}
+
+/* gemm_specialization
+ * A kernel of this file compiled for fixed sizes.
+ */
+struct gemm_specialization {
+  const char* name;
+  kernel_variant variant;
+  /* Side of the square work-groups */
+  int workGroupSide;
+  /* Side of the square tile of C computed by a work-item */
+  int microTile;
+  /* Width along K of the tiles of A and B in local memory */
+  int tileK;
+
+  /* Side of the tile of C computed by a work-group */
+  int tile_size() const { return workGroupSide * microTile; }
+
+  /* Elements of local memory used by a work-group */
+  std::size_t local_elements() const {
+    std::size_t rows = tile_size() + 1;
+    return (variant == kernel_variant::tiled) ? 2 * tileK * rows
+                                              : 4 * tileK * rows;
+  }
+};
+
+/* specialization_supported.
+ * Returns true if the work-groups and the local memory of the
+ * specialization fit the device, for elements of elemSize bytes.
+ */
+inline bool specialization_supported(const gemm_specialization& spec,
+                                     const cl::sycl::device& d,
+                                     std::size_t elemSize) {
+  using namespace cl::sycl;
+  auto maxWorkGroup = d.get_info<info::device::max_work_group_size>();
+  auto localMem = d.get_info<info::device::local_mem_size>();
+  return std::size_t(spec.workGroupSide * spec.workGroupSide) <=
+             maxWorkGroup &&
+         spec.local_elements() * elemSize <= localMem;
+}
+
+/* run_gemm.
+ * Enqueues the multiplication with the given kernel, and returns the
+ * event of the kernel. blockSize is the side of the work-groups of the
+ * tiled kernel. The register-tiled kernel uses work-groups of 16 x 16
+ * when blockSize allows it and its tiles fit in the local memory of the
+ * device, and of 8 x 8 otherwise, each work-item computing a 4 x 4 tile
+ * of C. When neither fits, the tiled kernel is used.
+ */
+template <typename T, typename AllocA, typename AllocB, typename AllocC>
+cl::sycl::event run_gemm(cl::sycl::queue& q, kernel_variant variant,
+                         const gemm_shape& s, T alpha,
+                         cl::sycl::buffer<T, 1, AllocA>& bA,
+                         cl::sycl::buffer<T, 1, AllocB>& bB, T beta,
+                         cl::sycl::buffer<T, 1, AllocC>& bC, int blockSize) {
+  if (variant == kernel_variant::register_tiled) {
+    const gemm_specialization wide = {"register_tiled_gemm<4, 4, 16>",
+                                      kernel_variant::register_tiled, 16, 4,
+                                      16};
+    const gemm_specialization narrow = {"register_tiled_gemm<4, 4, 8>",
+                                        kernel_variant::register_tiled, 8, 4,
+                                        16};
+    const auto device = q.get_device();
+    if (blockSize >= 16 &&
+        specialization_supported(wide, device, sizeof(T))) {
+      return register_tiled_gemm<4, 4, 16>(q, s, alpha, bA, bB, beta, bC);
+    } else if (blockSize >= 8 &&
+               specialization_supported(narrow, device, sizeof(T))) {
+      return register_tiled_gemm<4, 4, 8>(q, s, alpha, bA, bB, beta, bC);
+    }
+  }
+  return tiled_gemm(q, s, alpha, bA, bB, beta, bC, blockSize);
+}
+
+/* device_block_size.
+ * Side of the largest square work-group, with a power of two side, that
+ * the device of the queue supports.
+ */
+inline int device_block_size(cl::sycl::queue& q) {
+  auto maxSize =
+      q.get_device().get_info<cl::sycl::info::device::max_work_group_size>();
+  int blockSize = 1;
+  while (std::size_t(4 * blockSize * blockSize) <= maxSize) {
+    blockSize *= 2;
+  }
+  return blockSize;
+}
+
+template <typename T, bool TransA, typename AllocA, typename AllocX,
+          typename AllocY>
+class gemv_kernel;
+
+/* gemv.
+ * Computes y = alpha * op(A) * x + beta * y on the queue, where op(A) is
+ * m x n, and A is stored row-major with lda elements between its rows.
+ * x has n elements and y has m.
+ *
+ * The product reads every element of A once, so the kernel is limited by
+ * the bandwidth of global memory, and A is always read along its rows:
+ *  - When A is not transposed, each work-group computes one element of y,
+ *    its work-items reading adjacent elements of the row of A and adding
+ *    up one part of the row each, and the parts are then added up in
+ *    local memory.
+ *  - When A is transposed, an element of y is a column of A, so each
+ *    work-group computes workGroupSize / rows adjacent elements of y,
+ *    with rows work-items per element. Adjacent work-items read adjacent
+ *    columns of a row of A, each of the rows work-items of a column adds
+ *    up one part of it, and the parts are added up in local memory.
+ * workGroupSize must be a power of two.
+ * When beta is zero, y is not read.
+ */
+template <typename T, typename AllocA, typename AllocX, typename AllocY>
+cl::sycl::event gemv(cl::sycl::queue& q, bool transA, int m, int n,
+                     T alpha, cl::sycl::buffer<T, 1, AllocA>& bA, int lda,
+                     cl::sycl::buffer<T, 1, AllocX>& bX, T beta,
+                     cl::sycl::buffer<T, 1, AllocY>& bY,
+                     int workGroupSize = 256) {
+  using namespace cl::sycl;
+  if (m <= 0 || n <= 0) {
+    throw std::out_of_range("The dimensions of a GEMV must be positive");
+  }
+  if (workGroupSize <= 0 || (workGroupSize & (workGroupSize - 1)) != 0) {
+    throw std::out_of_range("The work-group size must be a power of two");
+  }
+  int rowsA = transA ? n : m;
+  int colsA = transA ? m : n;
+  if (lda < colsA) {
+    throw std::out_of_range("A leading dimension is smaller than a row");
+  }
+  if (std::size_t(rowsA - 1) * lda + colsA > bA.get_count() ||
+      std::size_t(n) > bX.get_count() || std::size_t(m) > bY.get_count()) {
+    throw std::out_of_range("A buffer is too small for the GEMV shape");
+  }
+  return q.submit([&](handler& cgh) {
+    auto pA = bA.template get_access<access::mode::read>(cgh);
+    auto pX = bX.template get_access<access::mode::read>(cgh);
+    auto pY = bY.template get_access<access::mode::read_write>(cgh);
+
+    using acc_t = typename gemm_accumulator<T>::type;
+    accessor<acc_t, 1, access::mode::read_write, access::target::local>
+        partial(range<1>(workGroupSize), cgh);
+    const acc_t alphaAcc = alpha;
+    const acc_t betaAcc = beta;
+
+    // Writes the sum of the parts of dimension 1 of the work-group
+    auto finish = [=](nd_item<2> it, acc_t sum, int i) {
+      const int lx = it.get_local(0);
+      const int ly = it.get_local(1);
+      const int wx = it.get_local_range(0);
+      const int wy = it.get_local_range(1);
+      partial[ly * wx + lx] = sum;
+      for (int step = wy / 2; step > 0; step /= 2) {
+        it.barrier(access::fence_space::local_space);
+        if (ly < step) {
+          partial[ly * wx + lx] += partial[(ly + step) * wx + lx];
+        }
+      }
+      if (ly == 0 && i < m) {
+        acc_t result = alphaAcc * partial[lx];
+        pY[i] = T((betaAcc == acc_t(0)) ? result
+                                        : result + betaAcc * acc_t(pY[i]));
+      }
+    };
+
+    if (!transA) {
+      // A work-group is one element of y, its dimension 1 goes along the
+      // row of A
+      const int wg = workGroupSize;
+      cgh.parallel_for<gemv_kernel<T, false, AllocA, AllocX, AllocY>>(
+          nd_range<2>(range<2>(1, m * wg), range<2>(1, wg)),
+          [=](nd_item<2> it) {
+            const int i = it.get_group(1);
+            acc_t sum = acc_t(0);
+            for (int p = it.get_local(1); p < n; p += wg) {
+              sum += acc_t(pA[i * lda + p]) * acc_t(pX[p]);
+            }
+            finish(it, sum, i);
+          });
+    } else {
+      // Dimension 0 goes along y, that is along the columns of A, and
+      // dimension 1 along the rows of A
+      const int wx = std::min(workGroupSize, 32);
+      const int wy = workGroupSize / wx;
+      cgh.parallel_for<gemv_kernel<T, true, AllocA, AllocX, AllocY>>(
+          nd_range<2>(range<2>(sycl_gemm_detail::round_up(m, wx), wy),
+                      range<2>(wx, wy)),
+          [=](nd_item<2> it) {
+            const int i = it.get_global(0);
+            acc_t sum = acc_t(0);
+            if (i < m) {
+              for (int p = it.get_local(1); p < n; p += wy) {
+                sum += acc_t(pA[p * lda + i]) * acc_t(pX[p]);
+              }
+            }
+            finish(it, sum, i);
+          });
+    }
+  });
+}
+
+namespace sycl_gemm_detail {
+
+/* Offsets of the matrices of the problems of a strided batch */
+struct strided_offsets {
+  int strideA;
+  int strideB;
+  int strideC;
+
+  int a(int p) const { return p * strideA; }
+  int b(int p) const { return p * strideB; }
+  int c(int p) const { return p * strideC; }
+};
+
+/* Offsets of the matrices of the problems of a batch, read from arrays */
+template <typename AccessorT>
+struct offset_arrays {
+  AccessorT offsetsA;
+  AccessorT offsetsB;
+  AccessorT offsetsC;
+
+  int a(int p) const { return offsetsA[p]; }
+  int b(int p) const { return offsetsB[p]; }
+  int c(int p) const { return offsetsC[p]; }
+};
+
+template <typename AccessorT>
+offset_arrays<AccessorT> make_offset_arrays(AccessorT a, AccessorT b,
+                                            AccessorT c) {
+  return offset_arrays<AccessorT>{a, b, c};
+}
+
+/* Elements of C computed by a work-item in each pass of batched_gemm */
+const int batch_elems_per_item = 16;
+
+/* check_batch_offsets.
+ * The batched kernel computes the indices of the elements in int, so
+ * throws std::out_of_range if the matrices of a problem that start at
+ * the given offsets end past the largest int.
+ */
+inline void check_batch_offsets(const gemm_shape& s, std::size_t offA,
+                                std::size_t offB, std::size_t offC) {
+  const std::size_t maxIndex = std::numeric_limits<int>::max();
+  std::size_t endA = std::size_t((s.transA ? s.k : s.m) - 1) * s.lda +
+                     (s.transA ? s.m : s.k);
+  std::size_t endB = std::size_t((s.transB ? s.n : s.k) - 1) * s.ldb +
+                     (s.transB ? s.k : s.n);
+  std::size_t endC = std::size_t(s.m - 1) * s.ldc + s.n;
+  if (offA + endA > maxIndex || offB + endB > maxIndex ||
+      offC + endC > maxIndex) {
+    throw std::out_of_range("The batch is too large for int indices");
+  }
+}
+
+/* batched_gemm_launch.
+ * Submits the kernel of batched_gemm. makeOffsets(cgh) returns the
+ * object that gives the offsets of the matrices of each problem.
+ * AllocO is the allocator of the offset arrays, void for strided
+ * batches, and only names the kernel.
+ */
+template <bool Strided, typename AllocO, typename T, typename AllocA,
+          typename AllocB, typename AllocC, typename MakeOffsetsT>
+cl::sycl::event batched_gemm_launch(cl::sycl::queue& q, const gemm_shape& s,
+                                    int count, T alpha,
+                                    cl::sycl::buffer<T, 1, AllocA>& bA,
+                                    cl::sycl::buffer<T, 1, AllocB>& bB,
+                                    T beta,
+                                    cl::sycl::buffer<T, 1, AllocC>& bC,
+                                    MakeOffsetsT makeOffsets);
+
+}  // namespace sycl_gemm_detail
+
+template <typename T, bool Strided, typename AllocA, typename AllocB,
+          typename AllocC, typename AllocO>
+class batched_gemm_kernel;
+
+/* batched_gemm.
+ * Computes C[p] = alpha * op(A[p]) * op(B[p]) + beta * C[p] on the queue
+ * for the count problems p of a batch, which all have the shape s, with
+ * a single kernel. This is much cheaper than a buffer and a kernel per
+ * problem when the matrices are small.
+ * In this overload, the matrices of problem p start at p * strideA,
+ * p * strideB and p * strideC in the buffers.
+ *
+ * The problems are spread over the work-groups of the kernel: when the
+ * matrices are small, several problems share a work-group, each of them
+ * computed by a team of the work-items, and when they are large, a whole
+ * work-group computes a single problem. A team goes through op(A) and
+ * op(B) in tiles along k that it copies to local memory, and every
+ * work-item computes up to 16 elements of C at a time.
+ * Like tiled_gemm, any shape and layout is supported, and C is not read
+ * when beta is zero. The matrices C of the problems must not overlap.
+ * Throws std::out_of_range if the shape does not fit in the buffers, the
+ * problems share C, the tiles of a single problem do not fit in local
+ * memory, or the last element of the batch is past the largest int.
+ */
+template <typename T, typename AllocA, typename AllocB, typename AllocC>
+cl::sycl::event batched_gemm(cl::sycl::queue& q, const gemm_shape& s,
+                             int count, T alpha,
+                             cl::sycl::buffer<T, 1, AllocA>& bA, int strideA,
+                             cl::sycl::buffer<T, 1, AllocB>& bB, int strideB,
+                             T beta, cl::sycl::buffer<T, 1, AllocC>& bC,
+                             int strideC) {
+  if (count <= 0 || strideA < 0 || strideB < 0 || strideC < 0) {
+    throw std::out_of_range(
+        "A batch needs a positive count and non-negative strides");
+  }
+  if (count > 1 && strideC == 0) {
+    throw std::out_of_range("The problems of a batch must not share C");
+  }
+  // The last problem of the batch must fit in the buffers
+  std::size_t lastA = std::size_t(count - 1) * strideA;
+  std::size_t lastB = std::size_t(count - 1) * strideB;
+  std::size_t lastC = std::size_t(count - 1) * strideC;
+  if (lastA >= bA.get_count() || lastB >= bB.get_count() ||
+      lastC >= bC.get_count()) {
+    throw std::out_of_range("A buffer is too small for the batch");
+  }
+  sycl_gemm_detail::check_shape(s, bA.get_count() - lastA,
+                                bB.get_count() - lastB,
+                                bC.get_count() - lastC);
+  sycl_gemm_detail::check_batch_offsets(s, lastA, lastB, lastC);
+  sycl_gemm_detail::strided_offsets offsets{strideA, strideB, strideC};
+  return sycl_gemm_detail::batched_gemm_launch<true, void>(
+      q, s, count, alpha, bA, bB, beta, bC,
+      [=](cl::sycl::handler&) { return offsets; });
+}
+
+/* batched_gemm.
+ * Like the strided batched_gemm, but the matrices of problem p start at
+ * offsetsA[p], offsetsB[p] and offsetsC[p] in the buffers, the way an
+ * array of pointers to the matrices would be used with host memory.
+ * The offsets are checked on the host before the kernel is submitted,
+ * and two problems must not have the same offset of C.
+ */
+template <typename T, typename AllocA, typename AllocB, typename AllocC,
+          typename AllocO>
+cl::sycl::event batched_gemm(cl::sycl::queue& q, const gemm_shape& s,
+                             int count, T alpha,
+                             cl::sycl::buffer<T, 1, AllocA>& bA,
+                             cl::sycl::buffer<int, 1, AllocO>& offsetsA,
+                             cl::sycl::buffer<T, 1, AllocB>& bB,
+                             cl::sycl::buffer<int, 1, AllocO>& offsetsB,
+                             T beta, cl::sycl::buffer<T, 1, AllocC>& bC,
+                             cl::sycl::buffer<int, 1, AllocO>& offsetsC) {
+  using namespace cl::sycl;
+  if (count <= 0 || offsetsA.get_count() < std::size_t(count) ||
+      offsetsB.get_count() < std::size_t(count) ||
+      offsetsC.get_count() < std::size_t(count)) {
+    throw std::out_of_range("A batch needs an offset for every problem");
+  }
+  sycl_gemm_detail::check_shape(s, bA.get_count(), bB.get_count(),
+                                bC.get_count());
+  {
+    std::vector<int> startsC(count);
+    auto oA = offsetsA.template get_access<access::mode::read,
+                                           access::target::host_buffer>();
+    auto oB = offsetsB.template get_access<access::mode::read,
+                                           access::target::host_buffer>();
+    auto oC = offsetsC.template get_access<access::mode::read,
+                                           access::target::host_buffer>();
+    for (int p = 0; p < count; p++) {
+      if (oA[p] < 0 || oB[p] < 0 || oC[p] < 0) {
+        throw std::out_of_range("The offsets of a batch must not be negative");
+      }
+      sycl_gemm_detail::check_shape(s, bA.get_count() - std::min<std::size_t>(
+                                           oA[p], bA.get_count()),
+                                    bB.get_count() - std::min<std::size_t>(
+                                        oB[p], bB.get_count()),
+                                    bC.get_count() - std::min<std::size_t>(
+                                        oC[p], bC.get_count()));
+      sycl_gemm_detail::check_batch_offsets(s, oA[p], oB[p], oC[p]);
+      startsC[p] = oC[p];
+    }
+    std::sort(startsC.begin(), startsC.end());
+    if (std::adjacent_find(startsC.begin(), startsC.end()) != startsC.end()) {
+      throw std::out_of_range("The problems of a batch must not share C");
+    }
+  }
+  return sycl_gemm_detail::batched_gemm_launch<false, AllocO>(
+      q, s, count, alpha, bA, bB, beta, bC, [&](handler& cgh) {
+        return sycl_gemm_detail::make_offset_arrays(
+            offsetsA.template get_access<access::mode::read>(cgh),
+            offsetsB.template get_access<access::mode::read>(cgh),
+            offsetsC.template get_access<access::mode::read>(cgh));
+      });
+}
+
+namespace sycl_gemm_detail {
+
+template <bool Strided, typename AllocO, typename T, typename AllocA,
+          typename AllocB, typename AllocC, typename MakeOffsetsT>
+cl::sycl::event batched_gemm_launch(cl::sycl::queue& q, const gemm_shape& s,
+                                    int count, T alpha,
+                                    cl::sycl::buffer<T, 1, AllocA>& bA,
+                                    cl::sycl::buffer<T, 1, AllocB>& bB,
+                                    T beta,
+                                    cl::sycl::buffer<T, 1, AllocC>& bC,
+                                    MakeOffsetsT makeOffsets) {
+  using namespace cl::sycl;
+  const int E = batch_elems_per_item;
+  const int BK = 16;
+  const int elems = s.m * s.n;
+  auto device = q.get_device();
+
+  // Largest work-group of up to 256 work-items, as a power of two
+  int groupSize = 1;
+  while (groupSize < 256 &&
+         std::size_t(groupSize * 2) <=
+             device.get_info<info::device::max_work_group_size>()) {
+    groupSize *= 2;
+  }
+  // Problems per work-group: as many as there are elements of C for the
+  // work-items, and as the tiles of A and B fit in local memory
+  const std::size_t localBytes =
+      device.get_info<info::device::local_mem_size>();
+  const std::size_t tileBytes = std::size_t(s.m + s.n) * sizeof(T);
+  int problems = 1;
+  while (problems * 2 <= groupSize && problems * 2 * elems <= groupSize * E &&
+         problems < count && problems * 2 * BK * tileBytes <= localBytes) {
+    problems *= 2;
+  }
+  const int kt = static_cast<int>(
+      std::min<std::size_t>(BK, localBytes / (problems * tileBytes)));
+  if (kt == 0) {
+    throw std::out_of_range("The matrices are too large for batched_gemm");
+  }
+  const int teamSize = groupSize / problems;
+  const int numGroups = (count + problems - 1) / problems;
+
+  return q.submit([&](handler& cgh) {
+    auto pA = bA.template get_access<access::mode::read>(cgh);
+    auto pB = bB.template get_access<access::mode::read>(cgh);
+    auto pC = bC.template get_access<access::mode::read_write>(cgh);
+    auto offsets = makeOffsets(cgh);
+
+    // The tiles of op(A) (m x kt) and op(B) (kt x n) of every team
+    const int teamTile = kt * (s.m + s.n);
+    accessor<T, 1, access::mode::read_write, access::target::local> tiles(
+        range<1>(problems * teamTile), cgh);
+
+    const int m = s.m;
+    const int n = s.n;
+    const int k = s.k;
+    const bool transA = s.transA;
+    const bool transB = s.transB;
+    const int lda = s.lda;
+    const int ldb = s.ldb;
+    const int ldc = s.ldc;
+    using acc_t = typename gemm_accumulator<T>::type;
+    const acc_t alphaAcc = alpha;
+    const acc_t betaAcc = beta;
+
+    cgh.parallel_for<
+        batched_gemm_kernel<T, Strided, AllocA, AllocB, AllocC, AllocO>>(
+        nd_range<1>(range<1>(numGroups * groupSize), range<1>(groupSize)),
+        [=](nd_item<1> it) {
+          const int team = it.get_local(0) / teamSize;
+          const int t = it.get_local(0) % teamSize;
+          const int p = it.get_group(0) * problems + team;
+          // The teams of a missing problem still go through the barriers
+          const bool active = p < count;
+          const int offA = active ? offsets.a(p) : 0;
+          const int offB = active ? offsets.b(p) : 0;
+          const int offC = active ? offsets.c(p) : 0;
+          const int tileA = team * teamTile;
+          const int tileB = tileA + m * kt;
+
+          for (int base = 0; base < elems; base += teamSize * E) {
+            acc_t acc[E];
+            int rows[E];
+            int cols[E];
+            for (int j = 0; j < E; j++) {
+              int e = base + t + j * teamSize;
+              acc[j] = acc_t(0);
+              rows[j] = (e < elems) ? e / n : 0;
+              cols[j] = (e < elems) ? e % n : 0;
+            }
+
+            for (int k0 = 0; k0 < k; k0 += kt) {
+              if (active) {
+                // Adjacent work-items read adjacent elements for every
+                // layout
+                for (int idx = t; idx < m * kt; idx += teamSize) {
+                  int i = transA ? idx % m : idx / kt;
+                  int kk = transA ? idx / m : idx % kt;
+                  T a = T(0);
+                  if (k0 + kk < k) {
+                    a = transA ? pA[offA + (k0 + kk) * lda + i]
+                               : pA[offA + i * lda + k0 + kk];
+                  }
+                  tiles[tileA + i * kt + kk] = a;
+                }
+                for (int idx = t; idx < kt * n; idx += teamSize) {
+                  int kk = transB ? idx % kt : idx / n;
+                  int j = transB ? idx / kt : idx % n;
+                  T b = T(0);
+                  if (k0 + kk < k) {
+                    b = transB ? pB[offB + j * ldb + k0 + kk]
+                               : pB[offB + (k0 + kk) * ldb + j];
+                  }
+                  tiles[tileB + kk * n + j] = b;
+                }
+              }
+              it.barrier(access::fence_space::local_space);
+              if (active) {
+                for (int kk = 0; kk < kt; kk++) {
+                  for (int j = 0; j < E; j++) {
+                    acc[j] += acc_t(tiles[tileA + rows[j] * kt + kk]) *
+                              acc_t(tiles[tileB + kk * n + cols[j]]);
+                  }
+                }
+              }
+              it.barrier(access::fence_space::local_space);
+            }
+
+            for (int j = 0; j < E; j++) {
+              int e = base + t + j * teamSize;
+              if (active && e < elems) {
+                int index = offC + rows[j] * ldc + cols[j];
+                pC[index] =
+                    T((betaAcc == acc_t(0))
+                          ? alphaAcc * acc[j]
+                          : alphaAcc * acc[j] + betaAcc * acc_t(pC[index]));
+              }
+            }
+          }
+        });
+  });
+}
+
+}  // namespace sycl_gemm_detail
+
+#endif  // INCLUDE_SYCL_GEMM_HPP
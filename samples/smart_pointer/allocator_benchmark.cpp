@@ -0,0 +1,320 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  allocator_benchmark.cpp
+ *
+ *  Description:
+ *    Measures the cost of creating many short-lived SYCL buffers and
+ *    large staging buffers, and the bandwidth of kernels on host memory,
+ *    with the default allocator and with custom allocators.
+ *
+ **************************************************************************/
+
+#include <CL/sycl.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "arena_allocator.hpp"
+#if defined(__LP64__) || defined(_WIN64)
+#define HAS_POOL_ALLOCATOR
+#include "pool_allocator.hpp"
+#endif
+#if defined(__unix__) || defined(__APPLE__)
+#define HAS_HUGEPAGE_ALLOCATOR
+#include "hugepage_allocator.hpp"
+#endif
+#ifdef __linux__
+#define HAS_NUMA_ALLOCATOR
+#include "numa_allocator.hpp"
+#endif
+
+using namespace cl::sycl;
+
+using seconds_t = std::chrono::duration<double>;
+
+/* Each request creates numBuffers host staging buffers of numElems
+ * elements, writes them through a host accessor and destroys them.
+ * Returns the number of buffers per second.
+ */
+template <typename AllocatorT, typename BetweenRequests>
+double run(const std::string& name, const AllocatorT& alloc,
+           BetweenRequests betweenRequests, int numRequests, int numBuffers,
+           size_t numElems) {
+  auto start = std::chrono::steady_clock::now();
+  float checksum = 0.0f;
+  for (int r = 0; r < numRequests; r++) {
+    for (int b = 0; b < numBuffers; b++) {
+      buffer<float, 1, AllocatorT> buf(range<1>(numElems), alloc);
+      auto acc = buf.template get_access<access::mode::discard_write,
+                                         access::target::host_buffer>();
+      for (size_t i = 0; i < numElems; i++) {
+        acc[i] = static_cast<float>(b);
+      }
+      checksum += acc[numElems - 1];
+    }
+    betweenRequests();
+  }
+  seconds_t elapsed = std::chrono::steady_clock::now() - start;
+  double buffersPerSecond = (numRequests * numBuffers) / elapsed.count();
+  std::cout << name << ": " << buffersPerSecond << " buffers per second"
+            << " (checksum " << checksum << ")" << std::endl;
+  return buffersPerSecond;
+}
+
+/* Each iteration creates a large host staging buffer, fills it
+ * through a host accessor and copies it out, as a host transfer would.
+ * The time of the fill includes the page faults of new memory.
+ * Prints the bandwidth of the fill and of the copy.
+ */
+template <typename AllocatorT>
+void run_large(const std::string& name, const AllocatorT& alloc,
+               int numIterations, size_t numBytes) {
+  size_t numElems = numBytes / sizeof(float);
+  std::vector<float> dst(numElems);
+  seconds_t fillTime(0), copyTime(0);
+  for (int it = 0; it < numIterations; it++) {
+    buffer<float, 1, AllocatorT> buf(range<1>(numElems), alloc);
+    auto acc = buf.template get_access<access::mode::discard_write,
+                                       access::target::host_buffer>();
+    float* ptr = &acc[0];
+    auto start = std::chrono::steady_clock::now();
+    std::fill(ptr, ptr + numElems, static_cast<float>(it));
+    auto filled = std::chrono::steady_clock::now();
+    std::memcpy(dst.data(), ptr, numElems * sizeof(float));
+    auto copied = std::chrono::steady_clock::now();
+    fillTime += filled - start;
+    copyTime += copied - filled;
+  }
+  double gigaBytes = (double(numIterations) * numElems * sizeof(float)) / 1e9;
+  std::cout << name << ": fill " << gigaBytes / fillTime.count()
+            << " GB/s, copy " << gigaBytes / copyTime.count() << " GB/s"
+            << std::endl;
+}
+
+/* Each of numThreads threads allocates and releases numAllocs blocks of
+ * between 1 and maxElems elements with the allocator, keeping a few of
+ * them alive at any time, and optionally creates a buffer on each block.
+ * Prints the number of allocations per second of all the threads.
+ */
+template <typename AllocatorT>
+void run_threads(const std::string& name, unsigned numThreads, int numAllocs,
+                 size_t maxElems, bool withBuffers) {
+  auto work = [=]() {
+    AllocatorT alloc;
+    const int window = 8;
+    float* live[window] = {};
+    size_t sizes[window] = {};
+    for (int i = 0; i < numAllocs; i++) {
+      int w = i % window;
+      if (live[w] != nullptr) {
+        alloc.deallocate(live[w], sizes[w]);
+      }
+      sizes[w] = 1 + (i * 7919) % maxElems;
+      live[w] = alloc.allocate(sizes[w]);
+      if (withBuffers) {
+        buffer<float, 1, map_allocator<float>> buf(live[w],
+                                                   range<1>(sizes[w]));
+        buf.set_final_data(nullptr);
+      } else {
+        live[w][0] = static_cast<float>(i);
+      }
+    }
+    for (int w = 0; w < window; w++) {
+      if (live[w] != nullptr) {
+        alloc.deallocate(live[w], sizes[w]);
+      }
+    }
+  };
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < numThreads; t++) {
+    threads.emplace_back(work);
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  seconds_t elapsed = std::chrono::steady_clock::now() - start;
+  std::cout << name << ", " << numThreads << " threads: "
+            << (double(numThreads) * numAllocs) / elapsed.count()
+            << " allocations per second" << std::endl;
+}
+
+/* Streams through n floats of host memory with a kernel, giving the memory
+ * to the buffers with a map_allocator so that a CPU device reads and writes
+ * it directly. On systems with several sockets, the bandwidth depends on
+ * the NUMA node of the pages of the memory.
+ * Prints the bandwidth of the kernel.
+ */
+void run_bandwidth(const std::string& name, queue& q, float* in, float* out,
+                   size_t n, int numIterations) {
+  buffer<float, 1, map_allocator<float>> bIn(in, range<1>(n));
+  buffer<float, 1, map_allocator<float>> bOut(out, range<1>(n));
+  auto stream = [&]() {
+    q.submit([&](handler& cgh) {
+      auto a = bIn.get_access<access::mode::read>(cgh);
+      auto b = bOut.get_access<access::mode::discard_write>(cgh);
+      cgh.parallel_for<class stream_kernel>(
+          range<1>(n), [=](id<1> i) { b[i] = 2.0f * a[i]; });
+    });
+  };
+  // The first kernel includes the compilation of the kernel
+  stream();
+  q.wait();
+  auto start = std::chrono::steady_clock::now();
+  for (int it = 0; it < numIterations; it++) {
+    stream();
+  }
+  q.wait();
+  seconds_t elapsed = std::chrono::steady_clock::now() - start;
+  double gigaBytes = (2.0 * numIterations * n * sizeof(float)) / 1e9;
+  std::cout << name << ": " << gigaBytes / elapsed.count() << " GB/s"
+            << std::endl;
+}
+
+/* Reads a size from a command line argument.
+ * Returns 0 if the argument is not a positive number up to maxValue. */
+size_t parse_size(const char* arg, size_t maxValue) {
+  if (!std::isdigit(static_cast<unsigned char>(arg[0]))) {
+    return 0;
+  }
+  char* end = nullptr;
+  unsigned long long value = std::strtoull(arg, &end, 10);
+  if (*end != '\0' || value > maxValue) {
+    return 0;
+  }
+  return size_t(value);
+}
+
+int main(int argc, char* argv[]) {
+  const size_t maxSize = std::numeric_limits<size_t>::max();
+  int numRequests = (argc > 1) ? std::atoi(argv[1]) : 100;
+  int numBuffers = (argc > 2) ? std::atoi(argv[2]) : 1000;
+  size_t numElems =
+      (argc > 3) ? parse_size(argv[3], maxSize / sizeof(float)) : 256;
+  size_t largeMB = (argc > 4) ? parse_size(argv[4], maxSize >> 20) : 256;
+  size_t largeBytes = largeMB << 20;
+  if (numRequests <= 0 || numBuffers <= 0 || numElems == 0 ||
+      largeBytes == 0) {
+    std::cout << "Usage: " << argv[0]
+              << " [requests] [buffers per request] [elements per buffer]"
+                 " [MB per large buffer]"
+              << std::endl;
+    return 1;
+  }
+
+  std::cout << "Short-lived buffers" << std::endl;
+
+  run("default allocator", default_allocator<float>(), []() {}, numRequests,
+      numBuffers, numElems);
+
+  arena theArena;
+  run("arena allocator", arena_allocator<float>(theArena),
+      [&theArena]() { theArena.reset(); }, numRequests, numBuffers, numElems);
+  std::cout << "  arena high water mark: " << theArena.high_water_mark()
+            << " bytes in " << theArena.num_blocks() << " blocks"
+            << std::endl;
+
+  std::cout << "Large staging buffers" << std::endl;
+  const int largeIterations = 10;
+  run_large("default allocator", default_allocator<float>(), largeIterations,
+            largeBytes);
+  run_large("std::allocator", std::allocator<float>(), largeIterations,
+            largeBytes);
+#ifdef HAS_HUGEPAGE_ALLOCATOR
+  {
+    hugepage_pool pool;
+    run_large("huge pages", hugepage_allocator<float>(pool), largeIterations,
+              largeBytes);
+  }
+  {
+    hugepage_pool::options opts;
+    opts.lock = true;
+    hugepage_pool pool(opts);
+    run_large("huge pages, locked", hugepage_allocator<float>(pool),
+              largeIterations, largeBytes);
+    if (pool.locked_bytes() == 0) {
+      std::cout << "  (the memory could not be locked, see ulimit -l)"
+                << std::endl;
+    }
+  }
+#endif  // HAS_HUGEPAGE_ALLOCATOR
+
+  std::cout << "Concurrent small allocations" << std::endl;
+  unsigned numThreads = std::max(2u, std::thread::hardware_concurrency());
+  int numAllocs = numRequests * numBuffers;
+  for (bool withBuffers : {false, true}) {
+    std::string suffix = withBuffers ? " + buffer" : "";
+    for (unsigned t : {1u, numThreads}) {
+      run_threads<std::allocator<float>>("std::allocator" + suffix, t,
+                                         numAllocs, numElems, withBuffers);
+#ifdef HAS_POOL_ALLOCATOR
+      run_threads<pool_allocator<float>>("pool allocator" + suffix, t,
+                                         numAllocs, numElems, withBuffers);
+#endif  // HAS_POOL_ALLOCATOR
+    }
+  }
+#ifdef HAS_POOL_ALLOCATOR
+  std::cout << "  pool chunks: " << block_pool::instance().chunk_bytes()
+            << " bytes" << std::endl;
+#endif  // HAS_POOL_ALLOCATOR
+
+  std::cout << "Device bandwidth" << std::endl;
+  queue q;
+  if (!q.get_device().is_cpu()) {
+    std::cout << "  (the device is not a CPU, the placement of the host "
+                 "memory has no effect)"
+              << std::endl;
+  }
+  size_t bandwidthElems = largeBytes / sizeof(float);
+  {
+    // All the pages are touched by this thread, so they are all on its node
+    std::vector<float> in(bandwidthElems, 1.0f);
+    std::vector<float> out(bandwidthElems, 0.0f);
+    run_bandwidth("std::allocator", q, in.data(), out.data(), bandwidthElems,
+                  largeIterations);
+  }
+#ifdef HAS_NUMA_ALLOCATOR
+  for (auto policy : {numa_policy::interleave, numa_policy::block}) {
+    numa_allocator<float> alloc(policy);
+    float* in = alloc.allocate(bandwidthElems);
+    float* out = alloc.allocate(bandwidthElems);
+    std::fill(in, in + bandwidthElems, 1.0f);
+    run_bandwidth((policy == numa_policy::interleave) ? "NUMA interleaved"
+                                                      : "NUMA blocks",
+                  q, in, out, bandwidthElems, largeIterations);
+    alloc.deallocate(in, bandwidthElems);
+    alloc.deallocate(out, bandwidthElems);
+  }
+  std::cout << "  (" << numa_detail::online_nodes().size() << " NUMA nodes, "
+            << numa_allocator<float>::unplaced_bytes()
+            << " bytes not placed)" << std::endl;
+#endif  // HAS_NUMA_ALLOCATOR
+
+  return 0;
+}
@@ -0,0 +1,264 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  arena_allocator.hpp
+ *
+ *  Description:
+ *    Monotonic arena and an allocator that uses it, which can be
+ *    given to SYCL buffers as their AllocatorT.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_ARENA_ALLOCATOR_HPP
+#define INCLUDE_ARENA_ALLOCATOR_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+/* arena
+ * Monotonic allocator of memory.
+ * Memory is taken from a chain of blocks by moving a pointer forward,
+ * and is only given back all at once with reset(), which keeps the blocks
+ * for the next allocations. Like the stack_allocator, it is intended for
+ * short-lived allocations: after the first few resets, allocations do not
+ * call malloc or free at all.
+ * An arena is not thread-safe.
+ */
+class arena {
+ public:
+  /* Alignment of all the allocations, so that they can be
+   * used as host pointers by the SYCL runtime. */
+  static const std::size_t alignment = 64;
+
+  explicit arena(std::size_t blockSize = 1 << 20)
+      : m_blockSize((blockSize > alignment) ? blockSize : alignment),
+        m_first(nullptr),
+        m_current(nullptr),
+        m_top(nullptr),
+        m_used(0),
+        m_highWaterMark(0),
+        m_capacity(0),
+        m_numBlocks(0) {}
+
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  ~arena() {
+    while (m_first != nullptr) {
+      block* next = m_first->m_next;
+      std::free(m_first);
+      m_first = next;
+    }
+  }
+
+  /* allocate.
+   * Returns numBytes of memory aligned to the arena alignment.
+   */
+  void* allocate(std::size_t numBytes) {
+    std::size_t size = round_up(std::max<std::size_t>(numBytes, 1));
+    if (m_current == nullptr ||
+        size > static_cast<std::size_t>(m_current->end() - m_top)) {
+      next_block(size);
+    }
+    void* result = m_top;
+    m_top += size;
+    m_used += size;
+    m_highWaterMark = std::max(m_highWaterMark, m_used);
+    return result;
+  }
+
+  /* deallocate.
+   * Memory is only released by reset, except for the last allocation,
+   * which is given back right away.
+   */
+  void deallocate(void* ptr, std::size_t numBytes) {
+    std::size_t size = round_up(std::max<std::size_t>(numBytes, 1));
+    if (static_cast<char*>(ptr) + size == m_top) {
+      m_top -= size;
+      m_used -= size;
+    }
+  }
+
+  /* reset.
+   * Releases all the allocations at once. The blocks are kept,
+   * so allocations after the reset reuse them.
+   */
+  void reset() {
+    m_current = m_first;
+    m_top = (m_first != nullptr) ? m_first->begin() : nullptr;
+    m_used = 0;
+  }
+
+  /* Bytes allocated since the last reset */
+  std::size_t used() const { return m_used; }
+
+  /* Maximum number of bytes allocated between two resets */
+  std::size_t high_water_mark() const { return m_highWaterMark; }
+
+  /* Bytes in all the blocks of the arena */
+  std::size_t capacity() const { return m_capacity; }
+
+  std::size_t num_blocks() const { return m_numBlocks; }
+
+  /* thread_default.
+   * Arena of the calling thread, used by default-constructed
+   * arena_allocator objects.
+   */
+  static arena& thread_default() {
+    static thread_local arena theArena;
+    return theArena;
+  }
+
+ private:
+  struct block {
+    block* m_next;
+    std::size_t m_size;
+
+    /* The memory of the block starts at the first aligned
+     * address after the header */
+    char* begin() {
+      return reinterpret_cast<char*>(
+          round_up(reinterpret_cast<std::uintptr_t>(this + 1)));
+    }
+    char* end() { return begin() + m_size; }
+  };
+
+  static std::size_t round_up(std::size_t n) {
+    return (n + alignment - 1) & ~(alignment - 1);
+  }
+
+  /* next_block.
+   * Moves to the next block with room for size bytes, reusing the
+   * blocks of previous resets, or allocating a new one after the
+   * current block.
+   */
+  void next_block(std::size_t size) {
+    block* next = (m_current != nullptr) ? m_current->m_next : m_first;
+    if (next == nullptr || next->m_size < size) {
+      std::size_t blockSize = std::max(size, m_blockSize);
+      void* mem = std::malloc(sizeof(block) + alignment + blockSize);
+      if (mem == nullptr) {
+        throw std::bad_alloc();
+      }
+      block* b = static_cast<block*>(mem);
+      b->m_size = blockSize;
+      b->m_next = next;
+      if (m_current != nullptr) {
+        m_current->m_next = b;
+      } else {
+        m_first = b;
+      }
+      m_capacity += blockSize;
+      m_numBlocks++;
+      next = b;
+    }
+    m_current = next;
+    m_top = next->begin();
+  }
+
+  std::size_t m_blockSize;
+  block* m_first;
+  block* m_current;
+  char* m_top;
+  std::size_t m_used;
+  std::size_t m_highWaterMark;
+  std::size_t m_capacity;
+  std::size_t m_numBlocks;
+};
+
+/* arena_allocator
+ * Standard allocator that takes its memory from an arena.
+ * Copies of the allocator share the arena, which must outlive
+ * them and all the memory allocated with them.
+ * It can be used as the AllocatorT of a SYCL buffer:
+ *
+ *   arena a;
+ *   buffer<float, 1, arena_allocator<float>> buf(range<1>(n),
+ *                                                arena_allocator<float>(a));
+ *
+ * A default-constructed allocator uses arena::thread_default().
+ */
+template <typename T>
+class arena_allocator {
+ public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+
+  template <typename U>
+  struct rebind {
+    using other = arena_allocator<U>;
+  };
+
+  arena_allocator() : m_arena(&arena::thread_default()) {}
+
+  explicit arena_allocator(arena& a) : m_arena(&a) {}
+
+  template <typename U>
+  arena_allocator(const arena_allocator<U>& other)
+      : m_arena(other.get_arena()) {}
+
+  pointer allocate(size_type n, const void* = nullptr) {
+    return static_cast<pointer>(m_arena->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type n) {
+    m_arena->deallocate(p, n * sizeof(T));
+  }
+
+  size_type max_size() const { return std::size_t(-1) / sizeof(T); }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    new (p) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  void destroy(U* p) {
+    p->~U();
+  }
+
+  arena* get_arena() const { return m_arena; }
+
+ private:
+  arena* m_arena;
+};
+
+template <typename T1, typename T2>
+bool operator==(const arena_allocator<T1>& lhs,
+                const arena_allocator<T2>& rhs) {
+  return lhs.get_arena() == rhs.get_arena();
+}
+
+template <typename T1, typename T2>
+bool operator!=(const arena_allocator<T1>& lhs,
+                const arena_allocator<T2>& rhs) {
+  return !(lhs == rhs);
+}
+
+#endif  // INCLUDE_ARENA_ALLOCATOR_HPP
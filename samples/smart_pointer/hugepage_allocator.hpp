@@ -0,0 +1,275 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  hugepage_allocator.hpp
+ *
+ *  Description:
+ *    Allocator for large host staging buffers, backed by transparent
+ *    huge pages that are kept in a pool and reused.
+ *    Only available on POSIX systems.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_HUGEPAGE_ALLOCATOR_HPP
+#define INCLUDE_HUGEPAGE_ALLOCATOR_HPP
+
+#include <sys/mman.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <utility>
+
+/* hugepage_pool
+ * Maps memory in multiples of 2MB, aligned to 2MB, and advises the kernel
+ * to back it with transparent huge pages, so that large buffers need
+ * fewer TLB entries and page faults.
+ * Optionally, the memory is locked with mlock so it is never paged out,
+ * and touched when mapped so its page faults do not happen in the
+ * first transfer.
+ * Freed memory is kept in the pool and given to the next allocations
+ * that fit in it, until release() returns it to the system.
+ * The pool is thread-safe.
+ */
+class hugepage_pool {
+ public:
+  static const std::size_t huge_page_size = std::size_t(2) << 20;
+
+  struct options {
+    /* Lock the memory with mlock. When the limit of locked memory
+     * (RLIMIT_MEMLOCK) is too low, the memory is not locked. */
+    bool lock = false;
+    /* Touch every page when the memory is mapped */
+    bool prefault = true;
+  };
+
+  hugepage_pool() : hugepage_pool(options()) {}
+
+  explicit hugepage_pool(options opts)
+      : m_options(opts), m_mappedBytes(0), m_lockedBytes(0) {}
+
+  hugepage_pool(const hugepage_pool&) = delete;
+  hugepage_pool& operator=(const hugepage_pool&) = delete;
+
+  ~hugepage_pool() {
+    for (auto& m : m_mappings) {
+      unmap(m.first, m.second);
+    }
+  }
+
+  /* allocate.
+   * Returns at least numBytes of memory, reusing a free mapping of the
+   * pool when there is one that is not more than twice as large.
+   * Zero bytes take one huge page, since mmap cannot map an empty range
+   * and every allocation needs its own address to be deallocated.
+   */
+  void* allocate(std::size_t numBytes) {
+    std::size_t size = round_up(numBytes == 0 ? 1 : numBytes);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_free.lower_bound(size);
+    if (it != m_free.end() && it->first <= 2 * size) {
+      void* ptr = it->second;
+      m_free.erase(it);
+      return ptr;
+    }
+    return map(size);
+  }
+
+  /* deallocate.
+   * Gives the memory back to the pool.
+   */
+  void deallocate(void* ptr) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_mappings.find(ptr);
+    if (it != m_mappings.end()) {
+      m_free.emplace(it->second.m_size, ptr);
+    }
+  }
+
+  /* release.
+   * Returns the free memory of the pool to the system.
+   */
+  void release() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto& f : m_free) {
+      auto it = m_mappings.find(f.second);
+      unmap(it->first, it->second);
+      m_mappings.erase(it);
+    }
+    m_free.clear();
+  }
+
+  /* Bytes mapped by the pool, either in use or free */
+  std::size_t mapped_bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_mappedBytes;
+  }
+
+  /* Bytes of the mapped memory that have been locked */
+  std::size_t locked_bytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_lockedBytes;
+  }
+
+  /* Pool used by default-constructed hugepage_allocator objects */
+  static hugepage_pool& global() {
+    static hugepage_pool thePool;
+    return thePool;
+  }
+
+ private:
+  static std::size_t round_up(std::size_t n) {
+    return ((n + huge_page_size - 1) / huge_page_size) * huge_page_size;
+  }
+
+  struct mapping {
+    std::size_t m_size;
+    bool m_locked;
+  };
+
+  /* map.
+   * Maps size bytes aligned to the huge page size, by mapping an extra
+   * huge page and unmapping the parts before and after the aligned range.
+   */
+  void* map(std::size_t size) {
+    std::size_t mapSize = size + huge_page_size;
+    void* mem = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(mem);
+    std::uintptr_t aligned =
+        (begin + huge_page_size - 1) & ~(huge_page_size - 1);
+    if (aligned != begin) {
+      munmap(mem, aligned - begin);
+    }
+    std::size_t tail = (begin + mapSize) - (aligned + size);
+    if (tail > 0) {
+      munmap(reinterpret_cast<void*>(aligned + size), tail);
+    }
+    char* ptr = reinterpret_cast<char*>(aligned);
+
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+    // mlock faults all the pages in
+    mapping m{size, m_options.lock && mlock(ptr, size) == 0};
+    if (!m.m_locked && m_options.prefault) {
+      for (std::size_t i = 0; i < size; i += huge_page_size) {
+        ptr[i] = 0;
+      }
+    }
+    m_mappings.emplace(ptr, m);
+    m_mappedBytes += size;
+    m_lockedBytes += m.m_locked ? size : 0;
+    return ptr;
+  }
+
+  void unmap(void* ptr, const mapping& m) {
+    munmap(ptr, m.m_size);
+    m_mappedBytes -= m.m_size;
+    m_lockedBytes -= m.m_locked ? m.m_size : 0;
+  }
+
+  options m_options;
+  mutable std::mutex m_mutex;
+  /* Every mapping of the pool, in use or free */
+  std::unordered_map<void*, mapping> m_mappings;
+  /* Free mappings, sorted by size */
+  std::multimap<std::size_t, void*> m_free;
+  std::size_t m_mappedBytes;
+  std::size_t m_lockedBytes;
+};
+
+/* hugepage_allocator
+ * Standard allocator that takes its memory from a hugepage_pool.
+ * It is intended for large buffers, since every allocation takes
+ * at least one huge page. It can be used as the AllocatorT of a
+ * SYCL buffer, for staging buffers that are created repeatedly:
+ *
+ *   buffer<float, 1, hugepage_allocator<float>> buf(range<1>(n));
+ *
+ * A default-constructed allocator uses hugepage_pool::global().
+ */
+template <typename T>
+class hugepage_allocator {
+ public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+
+  template <typename U>
+  struct rebind {
+    using other = hugepage_allocator<U>;
+  };
+
+  hugepage_allocator() : m_pool(&hugepage_pool::global()) {}
+
+  explicit hugepage_allocator(hugepage_pool& pool) : m_pool(&pool) {}
+
+  template <typename U>
+  hugepage_allocator(const hugepage_allocator<U>& other)
+      : m_pool(other.get_pool()) {}
+
+  pointer allocate(size_type n, const void* = nullptr) {
+    return static_cast<pointer>(m_pool->allocate(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type) { m_pool->deallocate(p); }
+
+  size_type max_size() const { return std::size_t(-1) / sizeof(T); }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    new (p) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  void destroy(U* p) {
+    p->~U();
+  }
+
+  hugepage_pool* get_pool() const { return m_pool; }
+
+ private:
+  hugepage_pool* m_pool;
+};
+
+template <typename T1, typename T2>
+bool operator==(const hugepage_allocator<T1>& lhs,
+                const hugepage_allocator<T2>& rhs) {
+  return lhs.get_pool() == rhs.get_pool();
+}
+
+template <typename T1, typename T2>
+bool operator!=(const hugepage_allocator<T1>& lhs,
+                const hugepage_allocator<T2>& rhs) {
+  return !(lhs == rhs);
+}
+
+#endif  // INCLUDE_HUGEPAGE_ALLOCATOR_HPP
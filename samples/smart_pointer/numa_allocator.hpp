@@ -0,0 +1,315 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  numa_allocator.hpp
+ *
+ *  Description:
+ *    Allocator that places the pages of host buffers across the NUMA
+ *    nodes of the system, for CPU devices that span several sockets.
+ *    Uses libnuma when HAVE_LIBNUMA is defined, and the mbind system
+ *    call otherwise. On other systems than Linux, memory is allocated
+ *    without any placement.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_NUMA_ALLOCATOR_HPP
+#define INCLUDE_NUMA_ALLOCATOR_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <unistd.h>
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#else
+#include <sys/syscall.h>
+#ifndef MPOL_BIND
+#define MPOL_BIND 2
+#endif
+#ifndef MPOL_INTERLEAVE
+#define MPOL_INTERLEAVE 3
+#endif
+#endif  // HAVE_LIBNUMA
+#endif  // __linux__
+
+/* numa_policy
+ * How the pages of an allocation are placed on the NUMA nodes.
+ */
+enum class numa_policy {
+  /* Pages are distributed round-robin across the nodes, so all the
+   * threads of the device see the same average latency. */
+  interleave,
+  /* The allocation is split in one contiguous block per node, in order.
+   * CPU devices usually split an nd_range in contiguous parts among their
+   * threads, so each part of the buffer is local to the socket that
+   * processes it. */
+  block
+};
+
+namespace numa_detail {
+
+#ifdef __linux__
+
+/* online_nodes.
+ * Returns the list of NUMA nodes with memory in the system, which is
+ * empty when the system does not report them.
+ */
+inline std::vector<int> online_nodes() {
+  std::vector<int> nodes;
+#ifdef HAVE_LIBNUMA
+  if (numa_available() >= 0) {
+    for (int n = 0; n <= numa_max_node(); n++) {
+      if (numa_bitmask_isbitset(numa_all_nodes_ptr, n)) {
+        nodes.push_back(n);
+      }
+    }
+  }
+#else
+  // The list is a set of ranges, e.g 0-1,3
+  std::ifstream online("/sys/devices/system/node/online");
+  std::string range;
+  while (std::getline(online, range, ',')) {
+    auto dash = range.find('-');
+    int first = std::atoi(range.c_str());
+    int last =
+        (dash == std::string::npos) ? first : std::atoi(&range[dash + 1]);
+    for (int n = first; n <= last; n++) {
+      nodes.push_back(n);
+    }
+  }
+#endif  // HAVE_LIBNUMA
+  return nodes;
+}
+
+/* place.
+ * Sets the policy of the pages in [ptr, ptr + numBytes) to the given
+ * nodes, before they are touched. Returns false if it was not possible.
+ */
+inline bool place(void* ptr, std::size_t numBytes, int mode,
+                  const std::vector<int>& nodes) {
+#ifdef HAVE_LIBNUMA
+  bitmask* mask = numa_allocate_nodemask();
+  for (int n : nodes) {
+    numa_bitmask_setbit(mask, n);
+  }
+  if (mode == MPOL_INTERLEAVE) {
+    numa_interleave_memory(ptr, numBytes, mask);
+  } else {
+    numa_tonodemask_memory(ptr, numBytes, mask);
+  }
+  numa_free_nodemask(mask);
+  return true;
+#else
+  const std::size_t bitsPerLong = 8 * sizeof(unsigned long);
+  std::vector<unsigned long> mask(1);
+  for (std::size_t n : nodes) {
+    if (n / bitsPerLong >= mask.size()) {
+      mask.resize(n / bitsPerLong + 1);
+    }
+    mask[n / bitsPerLong] |= 1UL << (n % bitsPerLong);
+  }
+  // The kernel reads maxnode - 1 bits of the mask
+  return syscall(SYS_mbind, ptr, numBytes, mode, mask.data(),
+                 mask.size() * bitsPerLong + 1, 0) == 0;
+#endif  // HAVE_LIBNUMA
+}
+
+#endif  // __linux__
+
+/* Bytes of the allocations whose pages could not be placed */
+inline std::atomic<std::size_t>& unplaced_bytes() {
+  static std::atomic<std::size_t> theCounter(0);
+  return theCounter;
+}
+
+/* Pages touched by each thread of touch; smaller allocations are
+ * touched by fewer threads, down to the calling thread alone */
+const std::size_t pages_per_touch_thread = 1024;
+
+/* touch.
+ * Writes every page of [ptr, ptr + numBytes) from several threads,
+ * so that the pages are allocated in parallel.
+ */
+inline void touch(char* ptr, std::size_t numBytes, std::size_t pageSize) {
+  std::size_t numPages = (numBytes + pageSize - 1) / pageSize;
+  std::size_t numThreads =
+      std::min<std::size_t>(std::thread::hardware_concurrency(),
+                            numPages / pages_per_touch_thread);
+  if (numThreads <= 1) {
+    for (std::size_t p = 0; p < numPages; p++) {
+      ptr[p * pageSize] = 0;
+    }
+    return;
+  }
+  std::size_t perThread = (numPages + numThreads - 1) / numThreads;
+  std::vector<std::thread> threads;
+  for (std::size_t t = 0; t < numThreads; t++) {
+    std::size_t first = t * perThread;
+    std::size_t last = std::min(numPages, first + perThread);
+    threads.emplace_back([=]() {
+      for (std::size_t p = first; p < last; p++) {
+        ptr[p * pageSize] = 0;
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+}
+
+}  // namespace numa_detail
+
+/* numa_allocator
+ * Standard allocator that maps memory directly from the system and
+ * places its pages on the NUMA nodes following a numa_policy.
+ * When the system reports no nodes, or the pages cannot be placed, the
+ * memory is left where the kernel puts it, and unplaced_bytes() counts
+ * it.
+ * The pages of large allocations are touched in parallel when
+ * allocated, so the allocation itself is not limited by the page faults
+ * of a single thread.
+ * It can be used as the AllocatorT of a SYCL buffer, or to allocate host
+ * memory that is given to a buffer with a map_allocator, so that
+ * a CPU device uses it directly:
+ *
+ *   numa_allocator<float> alloc(numa_policy::block);
+ *   float* ptr = alloc.allocate(n);
+ *   buffer<float, 1, map_allocator<float>> buf(ptr, range<1>(n));
+ */
+template <typename T>
+class numa_allocator {
+ public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+
+  template <typename U>
+  struct rebind {
+    using other = numa_allocator<U>;
+  };
+
+  explicit numa_allocator(numa_policy policy = numa_policy::interleave)
+      : m_policy(policy) {}
+
+  template <typename U>
+  numa_allocator(const numa_allocator<U>& other)
+      : m_policy(other.get_policy()) {}
+
+  pointer allocate(size_type n, const void* = nullptr) {
+    std::size_t numBytes = std::max<std::size_t>(n * sizeof(T), 1);
+#ifdef __linux__
+    void* mem = mmap(nullptr, numBytes, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem == MAP_FAILED) {
+      throw std::bad_alloc();
+    }
+    std::size_t pageSize = sysconf(_SC_PAGESIZE);
+    std::vector<int> nodes = numa_detail::online_nodes();
+    std::size_t unplaced = 0;
+    if (nodes.empty()) {
+      unplaced = numBytes;
+    } else if (m_policy == numa_policy::interleave) {
+      if (!numa_detail::place(mem, numBytes, MPOL_INTERLEAVE, nodes)) {
+        unplaced = numBytes;
+      }
+    } else {
+      std::size_t numPages = (numBytes + pageSize - 1) / pageSize;
+      std::size_t perNode = (numPages + nodes.size() - 1) / nodes.size();
+      for (std::size_t i = 0; i < nodes.size() && i * perNode < numPages;
+           i++) {
+        std::size_t pages = std::min(perNode, numPages - i * perNode);
+        if (!numa_detail::place(
+                static_cast<char*>(mem) + i * perNode * pageSize,
+                pages * pageSize, MPOL_BIND, std::vector<int>(1, nodes[i]))) {
+          unplaced += pages * pageSize;
+        }
+      }
+    }
+    // The last page of a block may be partly past the allocation
+    numa_detail::unplaced_bytes() += std::min(unplaced, numBytes);
+    numa_detail::touch(static_cast<char*>(mem), numBytes, pageSize);
+    return static_cast<pointer>(mem);
+#else
+    void* mem = std::malloc(numBytes);
+    if (mem == nullptr) {
+      throw std::bad_alloc();
+    }
+    return static_cast<pointer>(mem);
+#endif  // __linux__
+  }
+
+  void deallocate(pointer p, size_type n) {
+#ifdef __linux__
+    munmap(p, std::max<std::size_t>(n * sizeof(T), 1));
+#else
+    std::free(p);
+#endif  // __linux__
+  }
+
+  size_type max_size() const { return std::size_t(-1) / sizeof(T); }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    new (p) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  void destroy(U* p) {
+    p->~U();
+  }
+
+  numa_policy get_policy() const { return m_policy; }
+
+  /* Bytes allocated by any numa_allocator whose pages could not be
+   * placed following the policy */
+  static std::size_t unplaced_bytes() { return numa_detail::unplaced_bytes(); }
+
+ private:
+  numa_policy m_policy;
+};
+
+/* Memory of any numa_allocator can be released by any other */
+template <typename T1, typename T2>
+bool operator==(const numa_allocator<T1>&, const numa_allocator<T2>&) {
+  return true;
+}
+
+template <typename T1, typename T2>
+bool operator!=(const numa_allocator<T1>& lhs,
+                const numa_allocator<T2>& rhs) {
+  return !(lhs == rhs);
+}
+
+#endif  // INCLUDE_NUMA_ALLOCATOR_HPP
@@ -0,0 +1,349 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  pool_allocator.hpp
+ *
+ *  Description:
+ *    Lock-free pool of fixed-size blocks, and an allocator that uses it,
+ *    for small buffers created concurrently by several host threads.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_POOL_ALLOCATOR_HPP
+#define INCLUDE_POOL_ALLOCATOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <utility>
+
+/* block_pool
+ * Process-wide pool of blocks in size classes of powers of two, from
+ * 64 bytes to 64KB. Larger allocations go to operator new.
+ * Each size class has a global free list, which is a lock-free stack,
+ * and each thread keeps a small cache of free blocks of every class,
+ * so most allocations and releases do not touch shared memory at all.
+ * The cache moves blocks from and to the global lists in batches.
+ * Blocks are carved from chunks that are only released when the
+ * program finishes.
+ */
+class block_pool {
+ public:
+  static const std::size_t min_block_size = 64;
+  static const std::size_t max_block_size = 64 * 1024;
+  static const std::size_t num_classes = 11;
+  /* Free blocks of each class kept by a thread */
+  static const std::size_t cache_size = 32;
+
+  static block_pool& instance() {
+    static block_pool thePool;
+    return thePool;
+  }
+
+  void* allocate(std::size_t numBytes) {
+    if (numBytes > max_block_size) {
+      return ::operator new(numBytes);
+    }
+    std::size_t c = size_class(numBytes);
+    thread_cache& cache = local_cache();
+    if (cache.m_count[c] == 0) {
+      refill(cache, c);
+    }
+    return cache.m_blocks[c][--cache.m_count[c]];
+  }
+
+  void deallocate(void* ptr, std::size_t numBytes) {
+    if (numBytes > max_block_size) {
+      ::operator delete(ptr);
+      return;
+    }
+    std::size_t c = size_class(numBytes);
+    thread_cache& cache = local_cache();
+    if (cache.m_count[c] == cache_size) {
+      flush(cache, c, cache_size / 2);
+    }
+    cache.m_blocks[c][cache.m_count[c]++] = ptr;
+  }
+
+  /* Bytes of all the chunks of the pool */
+  std::size_t chunk_bytes() const {
+    return m_chunkBytes.load(std::memory_order_relaxed);
+  }
+
+  block_pool(const block_pool&) = delete;
+  block_pool& operator=(const block_pool&) = delete;
+
+  ~block_pool() {
+    chunk* c = m_chunks.load();
+    while (c != nullptr) {
+      chunk* next = c->m_next;
+      std::free(c);
+      c = next;
+    }
+  }
+
+ private:
+  /* A free block stores the next block of its list */
+  struct free_block {
+    std::atomic<free_block*> m_next;
+  };
+
+  struct chunk {
+    chunk* m_next;
+  };
+
+  /* The free lists are Treiber stacks. The head is a tagged pointer:
+   * the address of the top block in the low 48 bits, and a counter that
+   * changes on every push and pop in the high 16 bits, so that a block
+   * popped and pushed again by other threads does not make a stale
+   * compare-exchange succeed.
+   */
+  static const unsigned tag_shift = 48;
+  static const std::uint64_t pointer_mask =
+      (std::uint64_t(1) << tag_shift) - 1;
+
+  static_assert(sizeof(void*) == 8,
+                "block_pool packs tags in the high bits of 64 bit pointers");
+
+  static free_block* get_pointer(std::uint64_t head) {
+    return reinterpret_cast<free_block*>(head & pointer_mask);
+  }
+
+  static std::uint64_t next_head(std::uint64_t head, free_block* top) {
+    return (((head >> tag_shift) + 1) << tag_shift) |
+           reinterpret_cast<std::uint64_t>(top);
+  }
+
+  struct thread_cache {
+    void* m_blocks[num_classes][cache_size];
+    std::size_t m_count[num_classes];
+
+    thread_cache() {
+      for (std::size_t c = 0; c < num_classes; c++) {
+        m_count[c] = 0;
+      }
+    }
+
+    ~thread_cache() {
+      for (std::size_t c = 0; c < num_classes; c++) {
+        block_pool::instance().flush(*this, c, m_count[c]);
+      }
+    }
+  };
+
+  block_pool() : m_chunks{nullptr}, m_chunkBytes{0} {
+    for (auto& head : m_freeLists) {
+      head.store(0);
+    }
+  }
+
+  static thread_cache& local_cache() {
+    static thread_local thread_cache theCache;
+    return theCache;
+  }
+
+  static std::size_t size_class(std::size_t numBytes) {
+    std::size_t c = 0;
+    std::size_t size = min_block_size;
+    while (size < numBytes) {
+      size <<= 1;
+      c++;
+    }
+    return c;
+  }
+
+  /* push.
+   * Pushes the chain of blocks from first to last on the list of a class.
+   */
+  void push(std::size_t c, free_block* first, free_block* last) {
+    std::atomic<std::uint64_t>& list = m_freeLists[c];
+    std::uint64_t head = list.load(std::memory_order_relaxed);
+    do {
+      last->m_next.store(get_pointer(head), std::memory_order_relaxed);
+    } while (!list.compare_exchange_weak(head, next_head(head, first),
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  }
+
+  /* pop.
+   * The next pointer of the top block may be read after another thread
+   * has popped the block and written to it. The value is then discarded,
+   * since the tag of the head has changed and the compare-exchange fails,
+   * and the memory is still readable, since chunks are never released
+   * while the pool is alive.
+   */
+  free_block* pop(std::size_t c) {
+    std::atomic<std::uint64_t>& list = m_freeLists[c];
+    std::uint64_t head = list.load(std::memory_order_acquire);
+    free_block* top;
+    do {
+      top = get_pointer(head);
+      if (top == nullptr) {
+        return nullptr;
+      }
+    } while (!list.compare_exchange_weak(
+        head, next_head(head, top->m_next.load(std::memory_order_relaxed)),
+        std::memory_order_acquire, std::memory_order_acquire));
+    return top;
+  }
+
+  /* refill.
+   * Moves half a cache of blocks from the global list to the cache,
+   * carving a new chunk when the global list is empty.
+   */
+  void refill(thread_cache& cache, std::size_t c) {
+    while (cache.m_count[c] < cache_size / 2) {
+      free_block* b = pop(c);
+      if (b == nullptr) {
+        if (cache.m_count[c] == 0) {
+          new_chunk(c);
+          continue;
+        }
+        break;
+      }
+      cache.m_blocks[c][cache.m_count[c]++] = b;
+    }
+  }
+
+  /* flush.
+   * Moves the last numBlocks blocks of the cache to the global list,
+   * with a single push.
+   */
+  void flush(thread_cache& cache, std::size_t c, std::size_t numBlocks) {
+    if (numBlocks == 0) {
+      return;
+    }
+    free_block* first = nullptr;
+    free_block* last = nullptr;
+    for (std::size_t i = 0; i < numBlocks; i++) {
+      free_block* b =
+          new (cache.m_blocks[c][--cache.m_count[c]]) free_block{{first}};
+      if (last == nullptr) {
+        last = b;
+      }
+      first = b;
+    }
+    push(c, first, last);
+  }
+
+  /* new_chunk.
+   * Allocates a chunk for blocks of class c and pushes all its blocks
+   * on the global list.
+   */
+  void new_chunk(std::size_t c) {
+    std::size_t blockSize = min_block_size << c;
+    std::size_t numBlocks = (blockSize < 4096) ? 4096 / blockSize * 16 : 16;
+    // The blocks start at the first address aligned to min_block_size
+    // after the header of the chunk
+    std::size_t chunkBytes = 2 * min_block_size + numBlocks * blockSize;
+    void* mem = std::malloc(chunkBytes);
+    if (mem == nullptr) {
+      throw std::bad_alloc();
+    }
+    chunk* ch = static_cast<chunk*>(mem);
+    ch->m_next = m_chunks.load(std::memory_order_relaxed);
+    while (!m_chunks.compare_exchange_weak(ch->m_next, ch)) {
+    }
+    m_chunkBytes.fetch_add(chunkBytes, std::memory_order_relaxed);
+
+    char* blocks = reinterpret_cast<char*>(
+        (reinterpret_cast<std::uintptr_t>(ch + 1) + min_block_size - 1) &
+        ~(min_block_size - 1));
+    free_block* first = nullptr;
+    free_block* last = nullptr;
+    for (std::size_t i = numBlocks; i > 0; i--) {
+      free_block* b = new (blocks + (i - 1) * blockSize) free_block{{first}};
+      if (last == nullptr) {
+        last = b;
+      }
+      first = b;
+    }
+    push(c, first, last);
+  }
+
+  std::atomic<std::uint64_t> m_freeLists[num_classes];
+  std::atomic<chunk*> m_chunks;
+  std::atomic<std::size_t> m_chunkBytes;
+};
+
+/* pool_allocator
+ * Standard allocator that takes its memory from the block_pool.
+ * It has no state, so it can be default-constructed by a SYCL buffer
+ * when used as its AllocatorT, and memory allocated by one thread can
+ * be released by any other:
+ *
+ *   buffer<float, 1, pool_allocator<float>> buf(range<1>(n));
+ */
+template <typename T>
+class pool_allocator {
+ public:
+  using value_type = T;
+  using pointer = T*;
+  using const_pointer = const T*;
+  using reference = T&;
+  using const_reference = const T&;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+
+  template <typename U>
+  struct rebind {
+    using other = pool_allocator<U>;
+  };
+
+  pool_allocator() {}
+
+  template <typename U>
+  pool_allocator(const pool_allocator<U>&) {}
+
+  pointer allocate(size_type n, const void* = nullptr) {
+    return static_cast<pointer>(
+        block_pool::instance().allocate(n * sizeof(T)));
+  }
+
+  void deallocate(pointer p, size_type n) {
+    block_pool::instance().deallocate(p, n * sizeof(T));
+  }
+
+  size_type max_size() const { return std::size_t(-1) / sizeof(T); }
+
+  template <typename U, typename... Args>
+  void construct(U* p, Args&&... args) {
+    new (p) U(std::forward<Args>(args)...);
+  }
+
+  template <typename U>
+  void destroy(U* p) {
+    p->~U();
+  }
+};
+
+template <typename T1, typename T2>
+bool operator==(const pool_allocator<T1>&, const pool_allocator<T2>&) {
+  return true;
+}
+
+template <typename T1, typename T2>
+bool operator!=(const pool_allocator<T1>&, const pool_allocator<T2>&) {
+  return false;
+}
+
+#endif  // INCLUDE_POOL_ALLOCATOR_HPP
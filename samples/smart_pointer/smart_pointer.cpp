@@ -29,6 +29,8 @@
 
 // Custom stack allocator
 #include "stack_allocator.hpp"
+// Monotonic arena allocator
+#include "arena_allocator.hpp"
 
 using namespace cl::sycl;
 
@@ -160,5 +162,43 @@ int main() {
      * used in concert no data copy happens (i.e., it has already happened. */
   }
 
+  {
+    /* The arena_allocator takes memory from an arena, which only releases it
+     * all at once with reset(). The blocks of the arena are kept, so buffers
+     * created after the reset reuse them without calling malloc or free.
+     * This suits many short-lived buffers, e.g. host staging buffers created
+     * for each request of a server. */
+    arena requestArena;
+    for (int request = 0; request < 4; request++) {
+      for (int b = 0; b < 8; b++) {
+        buffer<int, 1, arena_allocator<int> > buf{
+            range<1>{nElems}, arena_allocator<int>(requestArena)};
+
+        myQueue.submit([&](handler &cgh) {
+          auto ptr = buf.get_access<access::mode::discard_write>(cgh);
+          cgh.parallel_for<class kernel3>(range<1>(nElems), [=](item<1> i) {
+            ptr[i] = static_cast<int>(i.get_linear_id());
+          });
+        });
+
+        auto hA =
+            buf.get_access<access::mode::read, access::target::host_buffer>();
+        int sum = 0;
+        for (int i = 0; i < nElems; i++) {
+          sum += hA[i];
+        }
+        if (sum != 66) {
+          correct = false;
+        }
+      }
+      /* All the buffers of the request have been destroyed */
+      requestArena.reset();
+    }
+    /* Only the first request allocated memory */
+    if (requestArena.num_blocks() != 1) {
+      correct = false;
+    }
+  }
+
   return correct ? 0 : 1;
 }
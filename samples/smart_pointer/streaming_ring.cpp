@@ -0,0 +1,171 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  streaming_ring.cpp
+ *
+ *  Description:
+ *    Sample code that streams batches of data from several host threads
+ *    to the device through a streaming_ring, and compares it with
+ *    creating one buffer per batch.
+ *
+ **************************************************************************/
+
+#include <CL/sycl.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "streaming_ring.hpp"
+
+using namespace cl::sycl;
+
+using seconds_t = std::chrono::duration<double>;
+
+/* Batch b of a run has b % 4 elements less than a full slot, and all its
+ * elements are b + 1, so the expected result is known in any order. */
+static size_t batch_size(int b, size_t slotSize) {
+  return slotSize - (b % 4);
+}
+
+/* Adds the first count elements of in to the total */
+static void accumulate(queue& q, buffer<int, 1, map_allocator<int>>& in,
+                       buffer<int, 1>& total, size_t count) {
+  q.submit([&](handler& cgh) {
+    auto a = in.get_access<access::mode::read>(cgh);
+    auto t = total.get_access<access::mode::read_write>(cgh);
+    cgh.parallel_for<class accumulate_kernel>(
+        range<1>(count), [=](id<1> i) { t[i] += a[i]; });
+  });
+}
+
+static bool check(buffer<int, 1>& total, int numBatches, size_t slotSize) {
+  std::vector<int> expected(slotSize, 0);
+  for (int b = 0; b < numBatches; b++) {
+    for (size_t i = 0; i < batch_size(b, slotSize); i++) {
+      expected[i] += b + 1;
+    }
+  }
+  auto t = total.get_access<access::mode::read, access::target::host_buffer>();
+  for (size_t i = 0; i < slotSize; i++) {
+    if (t[i] != expected[i]) {
+      std::cout << "Wrong value at " << i << ": " << t[i] << " instead of "
+                << expected[i] << std::endl;
+      return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  int numBatches = (argc > 1) ? std::atoi(argv[1]) : 1000;
+  size_t slotSize = (argc > 2) ? std::atoi(argv[2]) : 4096;
+  size_t numSlots = (argc > 3) ? std::atoi(argv[3]) : 8;
+  unsigned numProducers = 3;
+  if (numBatches <= 0 || slotSize < 4 || numSlots == 0) {
+    std::cout << "Usage: " << argv[0]
+              << " [batches] [elements per batch] [slots]" << std::endl;
+    return 1;
+  }
+  queue q;
+  bool correct = true;
+
+  {
+    /* Producers take the next batch number from a shared counter,
+     * and the main thread consumes the batches. */
+    buffer<int, 1> total(range<1>{slotSize});
+    {
+      auto t = total.get_access<access::mode::discard_write,
+                                access::target::host_buffer>();
+      for (size_t i = 0; i < slotSize; i++) {
+        t[i] = 0;
+      }
+    }
+    streaming_ring<int, ring_producers::multiple> ring(numSlots, slotSize);
+    std::atomic<int> nextBatch(0);
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> producers;
+    for (unsigned p = 0; p < numProducers; p++) {
+      producers.emplace_back([&]() {
+        for (int b = nextBatch++; b < numBatches; b = nextBatch++) {
+          ring.produce([=](int* ptr, size_t n) {
+            size_t count = batch_size(b, n);
+            for (size_t i = 0; i < count; i++) {
+              ptr[i] = b + 1;
+            }
+            return count;
+          });
+        }
+      });
+    }
+    for (int b = 0; b < numBatches; b++) {
+      ring.consume([&](streaming_ring<int>::buffer_t& buf, size_t count) {
+        accumulate(q, buf, total, count);
+      });
+    }
+    for (auto& th : producers) {
+      th.join();
+    }
+    q.wait();
+    seconds_t elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "Streaming ring, " << numProducers << " producers: "
+              << numBatches / elapsed.count() << " batches per second"
+              << std::endl;
+    correct = correct && check(total, numBatches, slotSize);
+  }
+
+  {
+    // The same batches with a new buffer for every batch
+    buffer<int, 1> total(range<1>{slotSize});
+    {
+      auto t = total.get_access<access::mode::discard_write,
+                                access::target::host_buffer>();
+      for (size_t i = 0; i < slotSize; i++) {
+        t[i] = 0;
+      }
+    }
+    std::vector<int> data(slotSize);
+    auto start = std::chrono::steady_clock::now();
+    for (int b = 0; b < numBatches; b++) {
+      size_t count = batch_size(b, slotSize);
+      for (size_t i = 0; i < count; i++) {
+        data[i] = b + 1;
+      }
+      // The buffer waits for the kernel when it is destroyed
+      buffer<int, 1, map_allocator<int>> buf(data.data(), range<1>(count));
+      buf.set_final_data(nullptr);
+      accumulate(q, buf, total, count);
+    }
+    q.wait();
+    seconds_t elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "One buffer per batch: " << numBatches / elapsed.count()
+              << " batches per second" << std::endl;
+    correct = correct && check(total, numBatches, slotSize);
+  }
+
+  if (!correct) {
+    std::cout << "The results are incorrect" << std::endl;
+    return 1;
+  }
+  return 0;
+}
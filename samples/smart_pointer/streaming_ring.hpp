@@ -0,0 +1,235 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  streaming_ring.hpp
+ *
+ *  Description:
+ *    Ring of host staging slots, each shared with a SYCL buffer through
+ *    a map_allocator, for data that is uploaded to the device
+ *    continuously by one or several producer threads.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_STREAMING_RING_HPP
+#define INCLUDE_STREAMING_RING_HPP
+
+#include <CL/sycl.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+/* ring_producers
+ * Number of threads that write into a streaming_ring.
+ */
+enum class ring_producers { single, multiple };
+
+/* streaming_ring
+ * Fixed set of numSlots staging slots of slotSize elements each, in one
+ * host allocation made with AllocatorT. Every slot is given to its own
+ * buffer with a map_allocator when the ring is created, so no buffer is
+ * created or destroyed while data is streamed.
+ *
+ * A slot goes around the ring in three steps:
+ *  - a producer claims a free slot and fills it through a host accessor,
+ *  - the consumer claims the filled slot and submits kernels on its buffer,
+ *  - the slot is free again as soon as the kernels are submitted. The
+ *    next producer to claim it waits in its host accessor until those
+ *    kernels have finished, so the SYCL runtime does the recycling.
+ *
+ * Slots are claimed with lock-free counters: every slot has a sequence
+ * number that tells whether it is free or filled for the current turn of
+ * the ring. When all the slots are filled, producers see the ring as
+ * full, which is the backpressure on the producers. With
+ * ring_producers::single the producer counter is only written by one
+ * thread and is updated without compare-exchange. There is always only
+ * one consumer thread.
+ *
+ * The memory of the slots can be locked with an allocator such as the
+ * hugepage_allocator, so the transfers of the device read it directly.
+ */
+template <typename T, ring_producers Producers = ring_producers::multiple,
+          typename AllocatorT = std::allocator<T>>
+class streaming_ring {
+ public:
+  using buffer_t = cl::sycl::buffer<T, 1, cl::sycl::map_allocator<T>>;
+
+  streaming_ring(std::size_t numSlots, std::size_t slotSize,
+                 const AllocatorT& alloc = AllocatorT())
+      : m_numSlots(numSlots),
+        m_slotSize(slotSize),
+        m_alloc(alloc),
+        m_memory(nullptr),
+        m_slots(new slot_state[numSlots]),
+        m_produced(0),
+        m_consumed(0) {
+    if (numSlots == 0 || slotSize == 0) {
+      throw std::out_of_range("A streaming ring needs at least one slot");
+    }
+    m_memory = m_alloc.allocate(numSlots * slotSize);
+    m_buffers.reserve(numSlots);
+    for (std::size_t i = 0; i < numSlots; i++) {
+      m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+      m_slots[i].m_count = 0;
+      m_buffers.emplace_back(m_memory + i * slotSize,
+                             cl::sycl::range<1>(slotSize));
+      // The data of a slot never needs to be copied back to the host
+      m_buffers.back().set_final_data(nullptr);
+    }
+  }
+
+  streaming_ring(const streaming_ring&) = delete;
+  streaming_ring& operator=(const streaming_ring&) = delete;
+
+  /* The buffers wait for their kernels before the memory is released */
+  ~streaming_ring() {
+    m_buffers.clear();
+    m_alloc.deallocate(m_memory, m_numSlots * m_slotSize);
+  }
+
+  /* try_produce.
+   * Claims a free slot and calls fill(ptr, slotSize) to write into it.
+   * fill returns the number of elements it wrote, which is given to the
+   * consumer. Returns false without calling fill if the ring is full.
+   */
+  template <typename FillT>
+  bool try_produce(FillT fill) {
+    std::size_t pos;
+    slot_state* s = claim(m_produced, 0, pos, Producers);
+    if (s == nullptr) {
+      return false;
+    }
+    std::size_t index = pos % m_numSlots;
+    {
+      auto acc = m_buffers[index].template get_access<
+          cl::sycl::access::mode::discard_write,
+          cl::sycl::access::target::host_buffer>();
+      s->m_count = fill(&acc[0], m_slotSize);
+    }
+    s->m_sequence.store(pos + 1, std::memory_order_release);
+    return true;
+  }
+
+  /* try_consume.
+   * Claims the oldest filled slot and calls submit(buf, count) with its
+   * buffer and the number of elements written in it. submit should
+   * submit the kernels that read the buffer. The slot is given back to
+   * the producers when submit returns. Returns false without calling
+   * submit if no slot is filled.
+   * Only one thread may consume from a ring.
+   */
+  template <typename SubmitT>
+  bool try_consume(SubmitT submit) {
+    std::size_t pos;
+    slot_state* s = claim(m_consumed, 1, pos, ring_producers::single);
+    if (s == nullptr) {
+      return false;
+    }
+    submit(m_buffers[pos % m_numSlots], s->m_count);
+    s->m_sequence.store(pos + m_numSlots, std::memory_order_release);
+    return true;
+  }
+
+  /* produce.
+   * Like try_produce, but waits for a free slot.
+   */
+  template <typename FillT>
+  void produce(FillT fill) {
+    while (!try_produce(fill)) {
+      std::this_thread::yield();
+    }
+  }
+
+  /* consume.
+   * Like try_consume, but waits for a filled slot.
+   */
+  template <typename SubmitT>
+  void consume(SubmitT submit) {
+    while (!try_consume(submit)) {
+      std::this_thread::yield();
+    }
+  }
+
+  std::size_t num_slots() const { return m_numSlots; }
+
+  std::size_t slot_size() const { return m_slotSize; }
+
+ private:
+  /* Counters written by different threads are kept on different
+   * cache lines, so producers and the consumer do not slow each other. */
+  struct alignas(64) counter {
+    std::atomic<std::size_t> m_value;
+
+    explicit counter(std::size_t v) : m_value(v) {}
+  };
+
+  struct slot_state {
+    /* pos when the slot is free for the producer of ticket pos, and
+     * pos + 1 when it is filled for the consumer of ticket pos */
+    std::atomic<std::size_t> m_sequence;
+    std::size_t m_count;
+  };
+
+  /* claim.
+   * Takes the next ticket of the counter if its slot has the expected
+   * sequence number, i.e. ticket + delta. Returns the slot, or nullptr
+   * if the slot is not ready yet.
+   */
+  slot_state* claim(counter& c, std::size_t delta, std::size_t& pos,
+                    ring_producers writers) {
+    pos = c.m_value.load(std::memory_order_relaxed);
+    for (;;) {
+      slot_state* s = &m_slots[pos % m_numSlots];
+      std::size_t seq = s->m_sequence.load(std::memory_order_acquire);
+      // The difference is taken as signed so the counters can wrap around
+      std::ptrdiff_t diff = static_cast<std::ptrdiff_t>(seq - (pos + delta));
+      if (diff != 0) {
+        if (diff < 0) {
+          return nullptr;
+        }
+        // Another producer took this ticket
+        pos = c.m_value.load(std::memory_order_relaxed);
+        continue;
+      }
+      if (writers == ring_producers::single) {
+        c.m_value.store(pos + 1, std::memory_order_relaxed);
+        return s;
+      }
+      if (c.m_value.compare_exchange_weak(pos, pos + 1,
+                                          std::memory_order_relaxed)) {
+        return s;
+      }
+    }
+  }
+
+  std::size_t m_numSlots;
+  std::size_t m_slotSize;
+  AllocatorT m_alloc;
+  T* m_memory;
+  std::unique_ptr<slot_state[]> m_slots;
+  std::vector<buffer_t> m_buffers;
+  counter m_produced;
+  counter m_consumed;
+};
+
+#endif  // INCLUDE_STREAMING_RING_HPP
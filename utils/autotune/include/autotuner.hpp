@@ -0,0 +1,312 @@
+/***************************************************************************
+ *  Copyright (C) 2017 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  autotuner.hpp
+ *
+ *  Description:
+ *    Chooses the fastest configuration of a kernel by running it, and
+ *    keeps the choice in a file for the later runs on the same device.
+ *
+ **************************************************************************/
+
+#ifndef INCLUDE_AUTOTUNER_HPP
+#define INCLUDE_AUTOTUNER_HPP
+
+#include <CL/sycl.hpp>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace codeplay {
+
+/* tuning_params
+ * Values of the parameters of one configuration of a kernel, for example
+ * a tile size, or the sizes of a work-group in each dimension.
+ */
+using tuning_params = std::vector<int>;
+
+/* rethrow_async_errors.
+ * Asynchronous handler that rethrows the first error of the list. The
+ * queues that run the candidates of autotuner::tune need a handler like
+ * this one, so that wait_and_throw throws when a candidate fails.
+ */
+inline void rethrow_async_errors(cl::sycl::exception_list errors) {
+  for (auto &e : errors) {
+    std::rethrow_exception(e);
+  }
+}
+
+/* tuning_result
+ * Configuration chosen by autotuner::tune.
+ */
+struct tuning_result {
+  tuning_params params;
+  /* Time of one run of the kernel with params, in seconds */
+  double seconds;
+  /* True when params came from the cache and nothing was run */
+  bool cached;
+};
+
+/* autotuner
+ * Chooses the configuration of a kernel among a list of candidates by
+ * timing a run of the kernel with each of them, the first time the
+ * kernel is used on a device for a class of problem sizes. The fastest
+ * configuration is stored in a cache file, keyed by the name of the
+ * kernel, the name and driver version of the device, and the size
+ * class, so the later runs, in this process or in another one, get it
+ * back without running anything.
+ *
+ * The size class of a problem is the base 2 logarithm of its size, so
+ * problems of similar sizes share their tuning.
+ * The cache is a text file with one configuration per line. It is read
+ * again before it is written, so processes that tune different kernels
+ * at the same time keep each other's results. When the file cannot be
+ * written, the results are only kept by this autotuner.
+ */
+class autotuner {
+ public:
+  /* Uses the cache file at path, or at default_cache_path() */
+  explicit autotuner(const std::string &path = default_cache_path())
+      : m_path(path), m_repetitions(3) {
+    load();
+  }
+
+  /* default_cache_path.
+   * The file named by the SYCL_AUTOTUNE_CACHE environment variable if it
+   * is set, .sycl_autotune_cache in the home directory otherwise.
+   */
+  static std::string default_cache_path() {
+    if (const char *path = std::getenv("SYCL_AUTOTUNE_CACHE")) {
+      return path;
+    }
+    const char *home = std::getenv("HOME");
+    if (home == nullptr) {
+      home = std::getenv("USERPROFILE");
+    }
+    std::string name = ".sycl_autotune_cache";
+    return (home != nullptr) ? std::string(home) + "/" + name : name;
+  }
+
+  /* size_class.
+   * Base 2 logarithm of the problem size, rounded down.
+   */
+  static int size_class(std::size_t problemSize) {
+    int c = 0;
+    while (problemSize > 1) {
+      problemSize >>= 1;
+      c++;
+    }
+    return c;
+  }
+
+  /* Number of timed runs of each candidate, after a first untimed run */
+  void set_repetitions(int repetitions) {
+    m_repetitions = std::max(1, repetitions);
+  }
+
+  const std::string &path() const { return m_path; }
+
+  /* find.
+   * Gets the cached configuration of the kernel for the device and size
+   * class of problemSize. Returns false if there is none.
+   */
+  bool find(const cl::sycl::device &d, const std::string &kernel,
+            std::size_t problemSize, tuning_result &result) const {
+    auto it = m_entries.find(make_key(d, kernel, problemSize));
+    if (it == m_entries.end()) {
+      return false;
+    }
+    result = it->second;
+    result.cached = true;
+    return true;
+  }
+
+  /* tune.
+   * Returns the cached configuration of the kernel if it is one of the
+   * candidates. Otherwise, calls run(params) with every candidate, once
+   * to warm up and then as many times as set_repetitions says, keeps the
+   * candidate with the shortest run and adds it to the cache.
+   * run must wait for the kernels it submits, with wait_and_throw on a
+   * queue whose asynchronous handler rethrows, such as
+   * rethrow_async_errors. A candidate for which run throws, for example
+   * because the device does not support its work-group size, is skipped.
+   * Throws std::runtime_error if run throws for every candidate.
+   */
+  template <typename RunT>
+  tuning_result tune(const cl::sycl::device &d, const std::string &kernel,
+                     std::size_t problemSize,
+                     const std::vector<tuning_params> &candidates, RunT run) {
+    tuning_result result;
+    if (find(d, kernel, problemSize, result) &&
+        std::find(candidates.begin(), candidates.end(), result.params) !=
+            candidates.end()) {
+      return result;
+    }
+    bool found = false;
+    for (const auto &params : candidates) {
+      double seconds = 0.0;
+      try {
+        run(params);
+        for (int r = 0; r < m_repetitions; r++) {
+          auto start = std::chrono::steady_clock::now();
+          run(params);
+          std::chrono::duration<double> elapsed =
+              std::chrono::steady_clock::now() - start;
+          seconds = (r == 0) ? elapsed.count()
+                             : std::min(seconds, elapsed.count());
+        }
+      } catch (const cl::sycl::exception &) {
+        continue;
+      } catch (const std::exception &) {
+        continue;
+      }
+      if (!found || seconds < result.seconds) {
+        result.params = params;
+        result.seconds = seconds;
+        found = true;
+      }
+    }
+    if (!found) {
+      throw std::runtime_error("No configuration of " + kernel + " runs");
+    }
+    result.cached = false;
+    save(make_key(d, kernel, problemSize), result);
+    return result;
+  }
+
+ private:
+  /* Tabs and line breaks separate the fields of the cache */
+  static std::string clean(std::string s) {
+    std::replace(s.begin(), s.end(), '\t', ' ');
+    std::replace(s.begin(), s.end(), '\n', ' ');
+    std::replace(s.begin(), s.end(), '\r', ' ');
+    return s;
+  }
+
+  static std::string make_key(const cl::sycl::device &d,
+                              const std::string &kernel,
+                              std::size_t problemSize) {
+    return clean(kernel) + "\t" +
+           clean(d.get_info<cl::sycl::info::device::name>()) + "\t" +
+           clean(d.get_info<cl::sycl::info::device::driver_version>()) +
+           "\t" + std::to_string(size_class(problemSize));
+  }
+
+  /* Reads the cache file into m_entries. A line is the key, the time
+   * and the parameters, separated by tabs. Lines that cannot be read
+   * are ignored. */
+  void load() {
+    std::ifstream in(m_path);
+    std::string line;
+    while (std::getline(in, line)) {
+      std::size_t paramsTab = line.rfind('\t');
+      if (paramsTab == std::string::npos || paramsTab == 0) {
+        continue;
+      }
+      std::size_t secondsTab = line.rfind('\t', paramsTab - 1);
+      if (secondsTab == std::string::npos) {
+        continue;
+      }
+      tuning_result result;
+      std::istringstream seconds(
+          line.substr(secondsTab + 1, paramsTab - secondsTab - 1));
+      if (!(seconds >> result.seconds)) {
+        continue;
+      }
+      std::istringstream params(line.substr(paramsTab + 1));
+      int value;
+      while (params >> value) {
+        result.params.push_back(value);
+      }
+      if (result.params.empty()) {
+        continue;
+      }
+      result.cached = true;
+      m_entries[line.substr(0, secondsTab)] = result;
+    }
+  }
+
+  /* Name of a new file next to the cache, which no other process, and no
+   * other save of this one, writes at the same time */
+  std::string temp_path() const {
+    static std::atomic<unsigned> counter(0);
+#ifdef _WIN32
+    int pid = _getpid();
+#else
+    int pid = getpid();
+#endif
+    std::ostringstream path;
+    path << m_path << "." << pid << "." << counter++ << ".tmp";
+    return path.str();
+  }
+
+  /* Adds an entry to the cache, with the entries that other processes
+   * wrote in the file since it was read, and replaces the file */
+  void save(const std::string &key, const tuning_result &result) {
+    load();
+    m_entries[key] = result;
+    std::string tmpPath = temp_path();
+    {
+      std::ofstream out(tmpPath, std::ios::trunc);
+      for (const auto &entry : m_entries) {
+        out << entry.first << "\t" << entry.second.seconds << "\t";
+        for (std::size_t i = 0; i < entry.second.params.size(); i++) {
+          out << (i ? " " : "") << entry.second.params[i];
+        }
+        out << "\n";
+      }
+      if (!out) {
+        std::remove(tmpPath.c_str());
+        return;
+      }
+    }
+    if (std::rename(tmpPath.c_str(), m_path.c_str()) != 0) {
+      // rename does not replace an existing file on every system
+      std::remove(m_path.c_str());
+      if (std::rename(tmpPath.c_str(), m_path.c_str()) != 0) {
+        std::remove(tmpPath.c_str());
+      }
+    }
+  }
+
+  std::string m_path;
+  int m_repetitions;
+  std::map<std::string, tuning_result> m_entries;
+};
+
+}  // namespace codeplay
+
+#endif  // INCLUDE_AUTOTUNER_HPP
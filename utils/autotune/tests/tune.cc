@@ -0,0 +1,170 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2017 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  tune.cc
+ *
+ *  Description:
+ *   Tests for the autotuner and its cache
+ *
+ **************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <CL/sycl.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "autotuner.hpp"
+
+using namespace codeplay;
+
+/* Cache file of a test, removed when the test starts */
+std::string cache_path(const std::string &test) {
+  std::string path = "autotune_test_" + test;
+  std::remove(path.c_str());
+  return path;
+}
+
+/* Runs of the kernel of the tests: the candidate {2} is the fastest */
+struct fake_kernel {
+  int *runs;
+
+  void operator()(const tuning_params &params) const {
+    (*runs)++;
+    int ms = (params[0] == 2) ? 1 : 5;
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+};
+
+const std::vector<tuning_params> candidates = {{1}, {2}, {3}};
+
+TEST(autotune, chooses_fastest) {
+  cl::sycl::device d;
+  autotuner tuner(cache_path("fastest"));
+  int runs = 0;
+  auto result = tuner.tune(d, "kernel", 1000, candidates, fake_kernel{&runs});
+  ASSERT_EQ(result.params, tuning_params{2});
+  ASSERT_FALSE(result.cached);
+  ASSERT_GT(result.seconds, 0.0);
+  // A warm-up run and three timed runs per candidate
+  ASSERT_EQ(runs, 12);
+}
+
+TEST(autotune, reuses_cache_file) {
+  cl::sycl::device d;
+  std::string path = cache_path("reuse");
+  int runs = 0;
+  {
+    autotuner tuner(path);
+    tuner.tune(d, "kernel", 1000, candidates, fake_kernel{&runs});
+  }
+  runs = 0;
+  autotuner tuner(path);
+  // Problems in the same size class use the same result
+  auto result = tuner.tune(d, "kernel", 1023, candidates, fake_kernel{&runs});
+  ASSERT_EQ(result.params, tuning_params{2});
+  ASSERT_TRUE(result.cached);
+  ASSERT_EQ(runs, 0);
+
+  // Another size class or another kernel is tuned again
+  tuner.set_repetitions(1);
+  result = tuner.tune(d, "kernel", 1024, candidates, fake_kernel{&runs});
+  ASSERT_FALSE(result.cached);
+  ASSERT_EQ(runs, 6);
+  result = tuner.tune(d, "other", 1000, candidates, fake_kernel{&runs});
+  ASSERT_FALSE(result.cached);
+  ASSERT_EQ(runs, 12);
+
+  // All the results are in the file
+  autotuner reader(path);
+  ASSERT_TRUE(reader.find(d, "kernel", 1000, result));
+  ASSERT_TRUE(reader.find(d, "kernel", 2000, result));
+  ASSERT_TRUE(reader.find(d, "other", 1000, result));
+  ASSERT_FALSE(reader.find(d, "other", 2000, result));
+}
+
+TEST(autotune, keeps_results_of_other_tuners) {
+  cl::sycl::device d;
+  std::string path = cache_path("merge");
+  autotuner first(path);
+  autotuner second(path);
+  int runs = 0;
+  first.set_repetitions(1);
+  second.set_repetitions(1);
+  first.tune(d, "first", 100, candidates, fake_kernel{&runs});
+  second.tune(d, "second", 100, candidates, fake_kernel{&runs});
+
+  autotuner reader(path);
+  tuning_result result;
+  ASSERT_TRUE(reader.find(d, "first", 100, result));
+  ASSERT_TRUE(reader.find(d, "second", 100, result));
+}
+
+TEST(autotune, skips_failing_candidates) {
+  cl::sycl::device d;
+  autotuner tuner(cache_path("failing"));
+  tuner.set_repetitions(1);
+  auto result = tuner.tune(d, "kernel", 100, candidates,
+                           [](const tuning_params &params) {
+                             if (params[0] != 3) {
+                               throw std::out_of_range("unsupported");
+                             }
+                           });
+  ASSERT_EQ(result.params, tuning_params{3});
+
+  ASSERT_THROW(tuner.tune(d, "none", 100, candidates,
+                          [](const tuning_params &) {
+                            throw std::out_of_range("unsupported");
+                          }),
+               std::runtime_error);
+}
+
+TEST(autotune, retunes_when_candidates_change) {
+  cl::sycl::device d;
+  autotuner tuner(cache_path("stale"));
+  tuner.set_repetitions(1);
+  int runs = 0;
+  tuner.tune(d, "kernel", 100, candidates, fake_kernel{&runs});
+  runs = 0;
+  auto result = tuner.tune(d, "kernel", 100, {{1}, {3}}, fake_kernel{&runs});
+  ASSERT_FALSE(result.cached);
+  ASSERT_EQ(runs, 4);
+}
+
+TEST(autotune, ignores_broken_lines) {
+  cl::sycl::device d;
+  std::string path = cache_path("broken");
+  {
+    std::ofstream out(path);
+    out << "garbage\n\tno key\nkernel\tdevice\t1.0\t3\tnot a time\t1\n";
+  }
+  autotuner tuner(path);
+  tuner.set_repetitions(1);
+  int runs = 0;
+  auto result = tuner.tune(d, "kernel", 8, candidates, fake_kernel{&runs});
+  ASSERT_EQ(result.params, tuning_params{2});
+  autotuner reader(path);
+  ASSERT_TRUE(reader.find(d, "kernel", 8, result));
+}
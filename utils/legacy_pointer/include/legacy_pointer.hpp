@@ -31,37 +31,122 @@
  **************************************************************************/
 
 #include <CL/sycl.hpp>
-#include <iostream>
 
-#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 namespace codeplay {
 namespace legacy {
 
+using sycl_acc_target = cl::sycl::access::target;
+using sycl_acc_mode = cl::sycl::access::mode;
+
 /**
- * PointerMapper
+ * offset_accessor
+ *  Accessor to the part of a buffer that starts at the offset
+ *  of a legacy pointer.
+ *  Element 0 of the offset_accessor is the element pointed by the
+ *  legacy pointer.
+ *  The accessor_t is a ranged accessor, whose indices are relative
+ *  to the start of the buffer.
+ */
+template <typename accessor_t>
+class offset_accessor {
+ public:
+  offset_accessor(accessor_t acc, size_t offset, size_t count)
+      : m_acc(acc), m_offset(offset), m_count(count) {}
+
+  auto operator[](size_t i) const -> decltype(std::declval<accessor_t>()[0]) {
+    return m_acc[m_offset + i];
+  }
+
+  /* get_pointer.
+   * Pointer to the first element of the accessed range
+   */
+  auto get_pointer() const -> decltype(&std::declval<accessor_t>()[0]) {
+    return &m_acc[m_offset];
+  }
+
+  /* Number of elements of the accessed range
+   */
+  size_t get_count() const { return m_count; }
+
+  /* Offset of the accessed range in the buffer
+   */
+  size_t get_offset() const { return m_offset; }
+
+  /* The accessor to the buffer
+   */
+  const accessor_t &get_accessor() const { return m_acc; }
+
+ private:
+  accessor_t m_acc;
+  size_t m_offset;
+  size_t m_count;
+};
+
+/* Bits of generation of the pointers unless a mapper chooses otherwise:
+ * 8 on 64 bit platforms, and none on 32 bit platforms, where all the
+ * bits are needed for the buffer id and the offset.
+ */
+const unsigned long default_generation_bits = (sizeof(void *) > 4) ? 8u : 0u;
+
+/**
+ * basic_pointer_mapper
  *  Associates fake pointers with buffers.
- *
+ *  BufferIdBits is the number of bits of the pointer used for the
+ *  buffer id, which limits the number of buffers alive at the same time.
+ *  GenerationBits is the number of bits used to detect pointers to
+ *  buffers that have been freed, see legacy_pointer_t.
+ *  The remaining bits hold the offset.
+ *  The buffer id and the generation together must fit in 32 bits, since
+ *  they are kept in the 32-bit state of a slot, so more than 24 bits of
+ *  buffer id on a 64 bit platform leave fewer bits for the generation,
+ *  e.g. basic_pointer_mapper<24, 0> has 40 bits of offset and does not
+ *  detect stale pointers.
  */
-class PointerMapper {
+template <unsigned long BufferIdBits,
+          unsigned long GenerationBits = default_generation_bits>
+class basic_pointer_mapper {
  public:
   /* pointer information definitions
    */
   static const unsigned long ADDRESS_BITS = sizeof(void *) * 8;
-  static const unsigned long BUFFER_ID_BITSIZE = 16u;
+  static const unsigned long BUFFER_ID_BITSIZE = BufferIdBits;
+  static const unsigned long GENERATION_BITSIZE = GenerationBits;
+  static const unsigned long OFFSET_BITSIZE =
+      ADDRESS_BITS - BUFFER_ID_BITSIZE - GENERATION_BITSIZE;
   static const unsigned long MAX_NUMBER_BUFFERS =
       (1UL << BUFFER_ID_BITSIZE) - 1;
-  static const unsigned long MAX_OFFSET =
-      (1UL << (ADDRESS_BITS - BUFFER_ID_BITSIZE)) - 1;
+  static const unsigned long MAX_GENERATION = (1UL << GENERATION_BITSIZE) - 1;
+  static const unsigned long MAX_OFFSET = (1UL << OFFSET_BITSIZE) - 1;
+
+  static_assert(BUFFER_ID_BITSIZE > 0 &&
+                    BUFFER_ID_BITSIZE + GENERATION_BITSIZE <= 32 &&
+                    BUFFER_ID_BITSIZE + GENERATION_BITSIZE < ADDRESS_BITS,
+                "The buffer id and the generation must fit in 32 bits "
+                "and leave room for the offset");
 
   using base_ptr_t = uintptr_t;
 
   /* Fake Pointers are constructed using an integer indexing plus
    * the offset:
    *
-   * |== MAX_BUFFERS ==|======== MAX_OFFSET ========|
-   * |   Buffer Id     |       Offset in buffer     |
-   * |=================|============================|
+   * |== MAX_BUFFERS ==|== GENERATION ==|====== MAX_OFFSET ======|
+   * |   Buffer Id     |   Generation   |    Offset in buffer    |
+   * |=================|================|========================|
+   *
+   * The buffer id is the index of a slot in the mapper, and the
+   * generation counts how many times that slot has been released.
+   * A pointer whose generation does not match the one of its slot
+   * refers to a buffer that has already been freed.
+   * On 32 bit platforms there are no generation bits by default, and
+   * without them a freed pointer may refer to a newer buffer of the
+   * same slot.
    */
   struct legacy_pointer_t {
     /* Type for the pointers
@@ -100,8 +185,12 @@ class PointerMapper {
    * A pointer is nullptr if the buffer id is 0,
    * i.e the first BUFFER_ID_BITSIZE are zero
    */
+  static constexpr bool is_nullptr(base_ptr_t ptr) {
+    return (ptr >> (ADDRESS_BITS - BUFFER_ID_BITSIZE)) == 0;
+  }
+
   static inline bool is_nullptr(legacy_pointer_t ptr) {
-    return ((MAX_OFFSET & ptr) == ptr);
+    return is_nullptr(static_cast<base_ptr_t>(ptr));
   }
 
   /* Base nullptr
@@ -116,119 +205,486 @@ class PointerMapper {
    */
   using buffer_t = cl::sycl::buffer<buffer_data_type, 1>;
 
-  /* id of a buffer in the map
+  /* id of a buffer in the map.
+   * Contains both the slot index and the generation of the pointer.
    */
-  using buffer_id = short;
+  using buffer_id = uint32_t;
 
   /* get_buffer_id
    */
-  inline buffer_id get_buffer_id(legacy_pointer_t ptr) const {
-    return ptr >> (ADDRESS_BITS - BUFFER_ID_BITSIZE);
+  static constexpr buffer_id get_buffer_id(base_ptr_t ptr) {
+    return static_cast<buffer_id>(ptr >> OFFSET_BITSIZE);
+  }
+
+  static inline buffer_id get_buffer_id(legacy_pointer_t ptr) {
+    return get_buffer_id(static_cast<base_ptr_t>(ptr));
   }
 
   /*
    * get_buffer_offset
    */
-  inline off_t get_offset(legacy_pointer_t ptr) const {
-    return ptr & MAX_OFFSET;
-    ;
+  static constexpr off_t get_offset(base_ptr_t ptr) {
+    return static_cast<off_t>(ptr & MAX_OFFSET);
+  }
+
+  static inline off_t get_offset(legacy_pointer_t ptr) {
+    return get_offset(static_cast<base_ptr_t>(ptr));
   }
 
   /**
-   * Constructs the PointerMapper structure.
+   * Constructs the basic_pointer_mapper structure.
    */
-  PointerMapper()
-      : m_pointerMap{}{};
+  basic_pointer_mapper() : m_pages{}, m_freeHead{0}, m_numSlots{0}, m_count{0} {};
+
+  /**
+   * basic_pointer_mapper cannot be copied or moved
+   */
+  basic_pointer_mapper(const basic_pointer_mapper &) = delete;
+
+  ~basic_pointer_mapper() {
+    clear();
+    for (auto &page : m_pages) {
+      delete[] page.load(std::memory_order_relaxed);
+    }
+  }
 
   /**
-   * PointerMapper cannot be copied or moved
+   * slot_cache
+   *  Keeps a few free slots for the exclusive use of one thread,
+   *  so that most allocations do not touch the shared free-slot stack.
+   *  The cache returns its slots to the mapper when destroyed,
+   *  so the mapper must outlive it.
    */
-  PointerMapper(const PointerMapper &) = delete;
+  class slot_cache {
+   public:
+    static const size_t CACHE_SIZE = 32;
+
+    explicit slot_cache(basic_pointer_mapper &pMap) : m_pMap(pMap), m_size{0} {}
+
+    slot_cache(const slot_cache &) = delete;
+
+    ~slot_cache() {
+      while (m_size > 0) {
+        m_pMap.push_free_slot(m_slots[--m_size]);
+      }
+    }
+
+   private:
+    friend class basic_pointer_mapper;
+
+    basic_pointer_mapper &m_pMap;
+    size_t m_slots[CACHE_SIZE];
+    size_t m_size;
+  };
 
   /**
   *	empty the pointer list
+  * Pointers created before the call are stale afterwards.
+  * It must not run at the same time as other operations on the mapper.
   */
-  inline void clear() { m_pointerMap.clear(); }
-
-  /* generate_id
-   * Generates a unique id for a buffer.
-   */
-  buffer_id generate_id() {
-    static buffer_id counter = 0;
-    return ++counter;
+  inline void clear() {
+    size_t numSlots = m_numSlots.load(std::memory_order_acquire);
+    if (numSlots > MAX_NUMBER_BUFFERS) {
+      numSlots = MAX_NUMBER_BUFFERS;
+    }
+    for (size_t i = numSlots; i > 0; i--) {
+      slot_t *slot = get_slot(i - 1);
+      if (slot != nullptr && release(*slot, slot->m_state.load())) {
+        push_free_slot(i - 1);
+      }
+    }
   }
 
   /* add_pointer.
    * Adds a pointer to the map and returns the fake pointer id.
-   * This will be the bufferId on the most significant bytes and 0 elsewhere.
+   * This will be the bufferId and the generation of its slot on the
+   * most significant bytes and 0 elsewhere.
+   * Returns the null pointer if all the buffer ids are in use.
+   * Can be called from several threads at the same time.
    */
   legacy_pointer_t add_pointer(buffer_t &&b) {
-    auto nextNumber = m_pointerMap.size();
-    buffer_id bId = generate_id();
-    m_pointerMap.emplace(bId, b);
-    if (nextNumber > MAX_NUMBER_BUFFERS) {
+    size_t index;
+    if (!pop_free_slot(index) && !new_slot(index)) {
       return null_legacy_ptr;
     }
-    base_ptr_t retVal = bId;
-    retVal <<= (ADDRESS_BITS - BUFFER_ID_BITSIZE);
-    return retVal;
+    return construct(index, std::move(b));
+  }
+
+  /* add_pointer.
+   * As above, but takes the slot from the cache of the calling
+   * thread when possible.
+   */
+  legacy_pointer_t add_pointer(buffer_t &&b, slot_cache &cache) {
+    size_t index;
+    if (cache.m_size > 0) {
+      index = cache.m_slots[--cache.m_size];
+    } else if (!pop_free_slot(index) && !new_slot(index)) {
+      return null_legacy_ptr;
+    }
+    return construct(index, std::move(b));
   }
 
   /* get_buffer.
-   * Returns a buffer from the map using the buffer id
+   * Returns a buffer from the map using the buffer id.
+   * The reference is valid until the pointer is freed.
+   * Throws std::out_of_range if the id does not belong to
+   * a live allocation.
+   * Lookups do not take locks, and can happen at the same time
+   * as allocations and releases of other pointers.
    */
-  buffer_t get_buffer(buffer_id bId) const {
-    auto it = m_pointerMap.find(bId);
-    if (it != m_pointerMap.end()) {
-      return it->second;
+  buffer_t &get_buffer(buffer_id bId) {
+    slot_t *slot = find_slot(bId);
+    if (slot == nullptr) {
+      throw std::out_of_range(
+          "No sycl buffer has been found. Make sure that you have "
+          "allocated memory for your buffer by calling malloc function.");
     }
+    return slot->buffer();
+  }
 
-    std::cerr << "No sycl buffer has been found. Make sure that you have "
-                 "allocated memory for your buffer by calling malloc function."
-              << std::endl;
-    std::abort();
+  /* get_access.
+   * Obtains an accessor to count bytes of the buffer, starting at the
+   * offset of the pointer. Only that range is requested from the
+   * SYCL runtime, so only that range is transferred to the device.
+   * Throws std::out_of_range if the range is outside of the buffer.
+   */
+  template <sycl_acc_mode access_mode,
+            sycl_acc_target access_target = sycl_acc_target::global_buffer>
+  offset_accessor<cl::sycl::accessor<buffer_data_type, 1, access_mode,
+                                     access_target>>
+  get_access(legacy_pointer_t ptr, size_t count, cl::sycl::handler &cgh) {
+    buffer_t &b = get_buffer(get_buffer_id(ptr));
+    size_t offset = get_offset(ptr);
+    check_range(b, offset, count);
+    return {b.get_access<access_mode, access_target>(
+                cgh, cl::sycl::range<1>{count}, cl::sycl::id<1>{offset}),
+            offset, count};
+  }
+
+  /* get_access.
+   * Obtains an accessor from the offset of the pointer
+   * to the end of its buffer.
+   */
+  template <sycl_acc_mode access_mode,
+            sycl_acc_target access_target = sycl_acc_target::global_buffer>
+  offset_accessor<cl::sycl::accessor<buffer_data_type, 1, access_mode,
+                                     access_target>>
+  get_access(legacy_pointer_t ptr, cl::sycl::handler &cgh) {
+    return get_access<access_mode, access_target>(
+        ptr, remaining_size(ptr), cgh);
+  }
+
+  /* get_access.
+   * Obtains a host accessor to count bytes of the buffer, starting
+   * at the offset of the pointer.
+   * Only that range is copied back to the host.
+   */
+  template <sycl_acc_mode access_mode,
+            sycl_acc_target access_target = sycl_acc_target::host_buffer>
+  offset_accessor<cl::sycl::accessor<buffer_data_type, 1, access_mode,
+                                     access_target>>
+  get_access(legacy_pointer_t ptr, size_t count) {
+    buffer_t &b = get_buffer(get_buffer_id(ptr));
+    size_t offset = get_offset(ptr);
+    check_range(b, offset, count);
+    return {b.get_access<access_mode>(cl::sycl::range<1>{count},
+                                      cl::sycl::id<1>{offset}),
+            offset, count};
+  }
+
+  /* get_access.
+   * Obtains a host accessor from the offset of the pointer
+   * to the end of its buffer.
+   */
+  template <sycl_acc_mode access_mode,
+            sycl_acc_target access_target = sycl_acc_target::host_buffer>
+  offset_accessor<cl::sycl::accessor<buffer_data_type, 1, access_mode,
+                                     access_target>>
+  get_access(legacy_pointer_t ptr) {
+    return get_access<access_mode, access_target>(ptr, remaining_size(ptr));
   }
 
   /* remove_pointer.
    * Removes the given pointer from the map.
+   * Pointers that have already been freed are ignored, so a stale
+   * pointer never releases the buffer that reuses its slot.
    */
   void remove_pointer(void *ptr) {
-    buffer_id bId = this->get_buffer_id(ptr);
-    m_pointerMap.erase(bId);
+    size_t index;
+    if (release_pointer(ptr, index)) {
+      push_free_slot(index);
+    }
+  }
+
+  /* remove_pointer.
+   * As above, but keeps the slot in the cache of the calling thread.
+   * When the cache is full, half of it goes back to the mapper.
+   */
+  void remove_pointer(void *ptr, slot_cache &cache) {
+    size_t index;
+    if (!release_pointer(ptr, index)) {
+      return;
+    }
+    if (cache.m_size == slot_cache::CACHE_SIZE) {
+      while (cache.m_size > slot_cache::CACHE_SIZE / 2) {
+        push_free_slot(cache.m_slots[--cache.m_size]);
+      }
+    }
+    cache.m_slots[cache.m_size++] = index;
   }
 
   /* count.
    * Return the number of active pointers (i.e, pointers that
    * have been malloc but not freed).
    */
-  size_t count() const { return m_pointerMap.size(); }
+  size_t count() const { return m_count.load(std::memory_order_relaxed); }
 
  private:
-  /* Maps the buffer id numbers to the actual buffer
-   * instances.
-    */
-  std::unordered_map<buffer_id, buffer_t> m_pointerMap;
+  /* check_range.
+   * Throws std::out_of_range if the range of bytes is empty
+   * or does not fit in the buffer.
+   */
+  static void check_range(buffer_t &b, size_t offset, size_t count) {
+    if (count == 0 || offset >= b.get_size() ||
+        count > b.get_size() - offset) {
+      throw std::out_of_range("The range is outside of the buffer");
+    }
+  }
+
+  /* remaining_size.
+   * Number of bytes from the pointer to the end of its buffer.
+   */
+  size_t remaining_size(legacy_pointer_t ptr) {
+    buffer_t &b = get_buffer(get_buffer_id(ptr));
+    size_t offset = get_offset(ptr);
+    return (offset < b.get_size()) ? b.get_size() - offset : 0;
+  }
+
+  /* Number of slots allocated at once
+   */
+  static const size_t PAGE_SIZE = 1024;
+  static const size_t NUMBER_PAGES =
+      (MAX_NUMBER_BUFFERS + PAGE_SIZE - 1) / PAGE_SIZE;
+
+  /* Marks a slot in use in its state.
+   * The rest of the state is the generation.
+   */
+  static const uint32_t USED_BIT = 1u;
+
+  /* Entry of the slot table.
+   * The buffer is constructed in place only while the slot is in use,
+   * since SYCL buffers cannot be default constructed.
+   */
+  struct slot_t {
+    typename std::aligned_storage<sizeof(buffer_t), alignof(buffer_t)>::type
+        m_storage;
+    /* generation << 1 | USED_BIT */
+    std::atomic<uint32_t> m_state{0};
+    /* next free slot + 1 while the slot is in the free-slot stack */
+    std::atomic<uint32_t> m_next{0};
+
+    buffer_t &buffer() { return *reinterpret_cast<buffer_t *>(&m_storage); }
+  };
+
+  /* get_slot.
+   * Returns the slot with the given index, or nullptr if its page
+   * has not been allocated yet.
+   */
+  slot_t *get_slot(size_t index) const {
+    slot_t *page = m_pages[index / PAGE_SIZE].load(std::memory_order_acquire);
+    return (page == nullptr) ? nullptr : &page[index % PAGE_SIZE];
+  }
+
+  /* find_slot.
+   * Returns the slot referred by the buffer id, or nullptr if
+   * the slot is not in use or the generation does not match.
+   */
+  slot_t *find_slot(buffer_id bId) const {
+    size_t index = bId >> GENERATION_BITSIZE;
+    if (index == 0 || index > MAX_NUMBER_BUFFERS) {
+      return nullptr;
+    }
+    slot_t *slot = get_slot(index - 1);
+    if (slot == nullptr ||
+        slot->m_state.load(std::memory_order_acquire) != used_state(bId)) {
+      return nullptr;
+    }
+    return slot;
+  }
+
+  static uint32_t used_state(buffer_id bId) {
+    return ((bId & MAX_GENERATION) << 1) | USED_BIT;
+  }
+
+  /* new_slot.
+   * Takes a slot that has never been used, allocating its page
+   * if needed. Returns false if all the buffer ids are taken.
+   */
+  bool new_slot(size_t &index) {
+    index = m_numSlots.fetch_add(1, std::memory_order_relaxed);
+    if (index >= MAX_NUMBER_BUFFERS) {
+      return false;
+    }
+    auto &page = m_pages[index / PAGE_SIZE];
+    if (page.load(std::memory_order_acquire) == nullptr) {
+      slot_t *newPage = new slot_t[PAGE_SIZE];
+      slot_t *expected = nullptr;
+      if (!page.compare_exchange_strong(expected, newPage,
+                                        std::memory_order_acq_rel)) {
+        delete[] newPage;
+      }
+    }
+    return true;
+  }
+
+  /* construct.
+   * Stores the buffer in a free slot and returns its fake pointer.
+   */
+  legacy_pointer_t construct(size_t index, buffer_t &&b) {
+    slot_t &slot = *get_slot(index);
+    new (&slot.m_storage) buffer_t(std::move(b));
+    uint32_t state = slot.m_state.load(std::memory_order_relaxed) | USED_BIT;
+    slot.m_state.store(state, std::memory_order_release);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    base_ptr_t retVal = ((index + 1) << GENERATION_BITSIZE) | (state >> 1);
+    retVal <<= OFFSET_BITSIZE;
+    return retVal;
+  }
+
+  /* release.
+   * Destroys the buffer of the slot and moves it to the next generation,
+   * if the slot is still in the given state. Only one thread can
+   * succeed when the same pointer is freed several times.
+   */
+  bool release(slot_t &slot, uint32_t state) {
+    if ((state & USED_BIT) == 0) {
+      return false;
+    }
+    uint32_t next = (((state >> 1) + 1) & MAX_GENERATION) << 1;
+    if (!slot.m_state.compare_exchange_strong(state, next,
+                                              std::memory_order_acq_rel)) {
+      return false;
+    }
+    slot.buffer().~buffer_t();
+    m_count.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  bool release_pointer(void *ptr, size_t &index) {
+    buffer_id bId = this->get_buffer_id(ptr);
+    slot_t *slot = find_slot(bId);
+    if (slot == nullptr || !release(*slot, used_state(bId))) {
+      return false;
+    }
+    index = (bId >> GENERATION_BITSIZE) - 1;
+    return true;
+  }
+
+  /* The free-slot stack is a Treiber stack linked through the slots.
+   * The head stores the index of the top slot + 1 in the low 32 bits,
+   * and a tag that changes on every push and pop in the high 32 bits,
+   * so that a slot popped and pushed again by other threads does not
+   * make a stale compare-exchange succeed.
+   */
+  void push_free_slot(size_t index) {
+    slot_t &slot = *get_slot(index);
+    uint64_t head = m_freeHead.load(std::memory_order_relaxed);
+    uint64_t newHead;
+    do {
+      slot.m_next.store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+      newHead = (((head >> 32) + 1) << 32) | (index + 1);
+    } while (!m_freeHead.compare_exchange_weak(head, newHead,
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
+  }
+
+  bool pop_free_slot(size_t &index) {
+    uint64_t head = m_freeHead.load(std::memory_order_acquire);
+    uint64_t newHead;
+    do {
+      uint32_t top = static_cast<uint32_t>(head);
+      if (top == 0) {
+        return false;
+      }
+      index = top - 1;
+      uint32_t next = get_slot(index)->m_next.load(std::memory_order_relaxed);
+      newHead = (((head >> 32) + 1) << 32) | next;
+    } while (!m_freeHead.compare_exchange_weak(head, newHead,
+                                               std::memory_order_acquire,
+                                               std::memory_order_acquire));
+    return true;
+  }
+
+  /* Pages of slots with the buffer instances, indexed by buffer id - 1.
+   * Pages are never freed while the mapper is alive, so references
+   * returned by get_buffer stay valid when the table grows.
+   */
+  std::atomic<slot_t *> m_pages[NUMBER_PAGES];
+
+  /* Head of the free-slot stack
+   */
+  std::atomic<uint64_t> m_freeHead;
+
+  /* Number of slots that have been handed out at least once
+   */
+  std::atomic<size_t> m_numSlots;
+
+  /* Number of slots in use
+   */
+  std::atomic<size_t> m_count;
 };
 
+/**
+ * PointerMapper
+ *  Default configuration, with 16 bits of buffer id.
+ */
+using PointerMapper = basic_pointer_mapper<16>;
+
 /**
  * Singleton interface to the pointer mapper to implement
  * the generic malloc/free C interface without extra
  * parameters.
+ * There is one pointer mapper for each size of the buffer id and
+ * of the generation.
  */
-inline PointerMapper &getPointerMapper() {
-  static PointerMapper thePointerMapper;
+template <unsigned long BufferIdBits = PointerMapper::BUFFER_ID_BITSIZE,
+          unsigned long GenerationBits = default_generation_bits>
+inline basic_pointer_mapper<BufferIdBits, GenerationBits> &getPointerMapper() {
+  static basic_pointer_mapper<BufferIdBits, GenerationBits> thePointerMapper;
   return thePointerMapper;
 }
 
+/**
+ * Cache of free slots of the singleton pointer mapper
+ * for the calling thread.
+ */
+template <unsigned long BufferIdBits = PointerMapper::BUFFER_ID_BITSIZE,
+          unsigned long GenerationBits = default_generation_bits>
+inline typename basic_pointer_mapper<BufferIdBits, GenerationBits>::slot_cache
+    &getSlotCache() {
+  using mapper_t = basic_pointer_mapper<BufferIdBits, GenerationBits>;
+  static thread_local typename mapper_t::slot_cache theSlotCache(
+      getPointerMapper<BufferIdBits, GenerationBits>());
+  return theSlotCache;
+}
+
 /**
  * Malloc-like interface to the pointer-mapper.
  * Given a size, creates a byte-typed buffer and returns a
  * fake pointer to keep track of it.
+ * Can be called from several threads at the same time.
+ * e.g, malloc<24>(size) uses the pointer mapper with 24 bits
+ * of buffer id.
  */
+template <unsigned long BufferIdBits = PointerMapper::BUFFER_ID_BITSIZE,
+          unsigned long GenerationBits = default_generation_bits>
 inline void *malloc(size_t size) {
+  using mapper_t = basic_pointer_mapper<BufferIdBits, GenerationBits>;
   // Create a generic buffer of the given size
-  auto thePointer = getPointerMapper().add_pointer(
-      PointerMapper::buffer_t(cl::sycl::range<1>{size}));
+  auto &pMap = getPointerMapper<BufferIdBits, GenerationBits>();
+  auto thePointer =
+      pMap.add_pointer(typename mapper_t::buffer_t(cl::sycl::range<1>{size}),
+                       getSlotCache<BufferIdBits, GenerationBits>());
   // Store the buffer on the global list
   return static_cast<void *>(thePointer);
 }
@@ -237,13 +693,26 @@ inline void *malloc(size_t size) {
  * Free-like interface to the pointer mapper.
  * Given a fake-pointer created with the legacy-pointer malloc,
  * destroys the buffer and remove it from the list.
+ * It must use the same BufferIdBits and GenerationBits as the malloc
+ * call.
+ * Can be called from several threads at the same time.
  */
-inline void free(void *ptr) { getPointerMapper().remove_pointer(ptr); }
+template <unsigned long BufferIdBits = PointerMapper::BUFFER_ID_BITSIZE,
+          unsigned long GenerationBits = default_generation_bits>
+inline void free(void *ptr) {
+  getPointerMapper<BufferIdBits, GenerationBits>().remove_pointer(
+      ptr, getSlotCache<BufferIdBits, GenerationBits>());
+}
 
 /**
  *clear the pointer list
+ * It must not run at the same time as malloc or free.
  */
-inline void clear() { getPointerMapper().clear(); }
+template <unsigned long BufferIdBits = PointerMapper::BUFFER_ID_BITSIZE,
+          unsigned long GenerationBits = default_generation_bits>
+inline void clear() {
+  getPointerMapper<BufferIdBits, GenerationBits>().clear();
+}
 
 }  // legacy
 }  // codeplay
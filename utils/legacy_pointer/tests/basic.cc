@@ -29,6 +29,7 @@
 
 #include <CL/sycl.hpp>
 #include <iostream>
+#include <vector>
 
 #include "legacy_pointer.hpp"
 
@@ -139,3 +140,114 @@ TEST(pointer_mapper, two_buffers) {
     ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
   }
 }
+
+TEST(pointer_mapper, stale_pointer) {
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+  void * ptrA = legacy::malloc(100 * sizeof(float));
+  buffer_id bIdA = legacy::getPointerMapper().get_buffer_id(ptrA);
+  legacy::free(ptrA);
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+
+  // The slot of A is reused, but with a different generation
+  void * ptrB = legacy::malloc(10 * sizeof(int));
+  buffer_id bIdB = legacy::getPointerMapper().get_buffer_id(ptrB);
+  ASSERT_NE(ptrA, ptrB);
+  ASSERT_NE(bIdA, bIdB);
+  ASSERT_THROW(legacy::getPointerMapper().get_buffer(bIdA),
+               std::out_of_range);
+  ASSERT_EQ(legacy::getPointerMapper().get_buffer(bIdB).get_size(),
+            10 * sizeof(int));
+
+  // Freeing the stale pointer does not release B
+  legacy::free(ptrA);
+  ASSERT_EQ(legacy::getPointerMapper().count(), 1u);
+  legacy::free(ptrB);
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+}
+
+TEST(pointer_mapper, reuse_ids) {
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+  // More allocations than buffer ids, but never more than two alive
+  void * ptrA = legacy::malloc(sizeof(float));
+  for (unsigned long i = 0; i < 2 * legacy::PointerMapper::MAX_NUMBER_BUFFERS;
+       i++) {
+    void * ptrB = legacy::malloc(sizeof(float));
+    ASSERT_FALSE(legacy::PointerMapper::is_nullptr(ptrB));
+    ASSERT_EQ(legacy::getPointerMapper().count(), 2u);
+    legacy::free(ptrB);
+  }
+  legacy::free(ptrA);
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+}
+
+TEST(pointer_mapper, clear) {
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+  void * ptrA = legacy::malloc(100 * sizeof(float));
+  void * ptrB = legacy::malloc(100 * sizeof(float));
+  buffer_id bIdA = legacy::getPointerMapper().get_buffer_id(ptrA);
+  ASSERT_EQ(legacy::getPointerMapper().count(), 2u);
+  legacy::clear();
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+  ASSERT_THROW(legacy::getPointerMapper().get_buffer(bIdA),
+               std::out_of_range);
+  legacy::free(ptrB);
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+}
+
+TEST(pointer_mapper, wide_buffer_id) {
+  using mapper24_t = legacy::basic_pointer_mapper<24>;
+  static_assert(mapper24_t::MAX_NUMBER_BUFFERS == (1UL << 24) - 1,
+                "24 bits of buffer id");
+  static_assert(mapper24_t::get_offset(mapper24_t::MAX_OFFSET + 3) == 2,
+                "Offsets are decoded at compile time");
+  static_assert(mapper24_t::get_buffer_id(mapper24_t::MAX_OFFSET + 1) == 1,
+                "Buffer ids are decoded at compile time");
+
+  // More buffers alive than the default mapper can hold
+  const size_t numBuffers = legacy::PointerMapper::MAX_NUMBER_BUFFERS + 100;
+  ASSERT_EQ(legacy::getPointerMapper<24>().count(), 0u);
+  std::vector<void *> ptrs;
+  for (size_t i = 0; i < numBuffers; i++) {
+    ptrs.push_back(legacy::malloc<24>(sizeof(float)));
+    ASSERT_FALSE(mapper24_t::is_nullptr(ptrs.back()));
+  }
+  ASSERT_EQ(legacy::getPointerMapper<24>().count(), numBuffers);
+  // The default mapper is not affected
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+
+  float * last = static_cast<float *>(ptrs.back()) + 5;
+  auto & pMap = legacy::getPointerMapper<24>();
+  ASSERT_EQ(pMap.get_offset(last), 5 * sizeof(float));
+  ASSERT_EQ(pMap.get_buffer(pMap.get_buffer_id(last)).get_size(),
+            sizeof(float));
+
+  for (void * ptr : ptrs) {
+    legacy::free<24>(ptr);
+  }
+  ASSERT_EQ(legacy::getPointerMapper<24>().count(), 0u);
+}
+
+TEST(pointer_mapper, no_generation) {
+  using mapper_t = legacy::basic_pointer_mapper<24, 0>;
+  static_assert(mapper_t::OFFSET_BITSIZE == mapper_t::ADDRESS_BITS - 24,
+                "All the bits but the buffer id are offset");
+  static_assert(mapper_t::get_buffer_id(mapper_t::MAX_OFFSET + 1) == 1,
+                "Buffer ids are decoded at compile time");
+
+  void * ptrA = legacy::malloc<24, 0>(sizeof(float));
+  auto & pMap = legacy::getPointerMapper<24, 0>();
+  ASSERT_EQ(pMap.count(), 1u);
+  float * elem = static_cast<float *>(ptrA) + 3;
+  ASSERT_EQ(pMap.get_offset(elem), 3 * sizeof(float));
+  ASSERT_EQ(pMap.get_buffer(pMap.get_buffer_id(elem)).get_size(),
+            sizeof(float));
+
+  // Without generation bits the slot is reused with the same pointer
+  legacy::free<24, 0>(ptrA);
+  void * ptrB = legacy::malloc<24, 0>(sizeof(float));
+  ASSERT_EQ(ptrA, ptrB);
+  legacy::free<24, 0>(ptrB);
+  ASSERT_EQ(pMap.count(), 0u);
+  // The mapper with generation bits is a different one
+  ASSERT_EQ(legacy::getPointerMapper<24>().count(), 0u);
+}
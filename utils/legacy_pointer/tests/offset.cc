@@ -172,3 +172,65 @@ TEST(offset, 2d_indexing) {
     ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
   }
 }
+
+TEST(offset, ranged_access) {
+  {
+    const size_t SIZE = 100;
+    const size_t SLICE = 5;
+    auto & pMap = legacy::getPointerMapper();
+    ASSERT_EQ(pMap.count(), 0u);
+    float * myPtr = static_cast<float *>(legacy::malloc(SIZE * sizeof(float)));
+    ASSERT_NE(myPtr, nullptr);
+    {
+      auto hostAcc = pMap.get_access<sycl_acc_mode::discard_write>(myPtr);
+      ASSERT_EQ(hostAcc.get_count(), SIZE * sizeof(float));
+      float * fPtr = reinterpret_cast<float *>(&*hostAcc.get_pointer());
+      for (unsigned i = 0; i < SIZE; i++) {
+        fPtr[i] = 0.0f;
+      }
+    }
+
+    float * slicePtr = myPtr + 10;
+    cl::sycl::queue q;
+    q.submit([&pMap, slicePtr, SLICE](cl::sycl::handler& h) {
+        auto acc = pMap.get_access<sycl_acc_rw>(
+                                    slicePtr, SLICE * sizeof(float), h);
+        h.single_task<class ranged_write>([=]() {
+            float * fPtr = reinterpret_cast<float *>(&*acc.get_pointer());
+            for (unsigned i = 0; i < SLICE; i++) {
+              fPtr[i] = i + 1;
+            }
+          });
+        });
+
+    // Host accessor to the slice only
+    {
+      auto hostAcc = pMap.get_access<sycl_acc_mode::read>(
+                                slicePtr, SLICE * sizeof(float));
+      ASSERT_EQ(hostAcc.get_offset(), 10 * sizeof(float));
+      ASSERT_EQ(hostAcc.get_count(), SLICE * sizeof(float));
+      const float * fPtr = reinterpret_cast<const float *>(
+                                          &*hostAcc.get_pointer());
+      for (unsigned i = 0; i < SLICE; i++) {
+        ASSERT_EQ(fPtr[i], i + 1);
+      }
+    }
+    // The rest of the buffer is unchanged
+    {
+      auto hostAcc = pMap.get_access<sycl_acc_mode::read>(myPtr);
+      const float * fPtr = reinterpret_cast<const float *>(
+                                          &*hostAcc.get_pointer());
+      ASSERT_EQ(fPtr[9], 0.0f);
+      ASSERT_EQ(fPtr[10 + SLICE], 0.0f);
+    }
+
+    ASSERT_THROW(pMap.get_access<sycl_acc_mode::read>(slicePtr,
+                                                      SIZE * sizeof(float)),
+                 std::out_of_range);
+    ASSERT_THROW(pMap.get_access<sycl_acc_mode::read>(myPtr + SIZE),
+                 std::out_of_range);
+
+    legacy::free(myPtr);
+    ASSERT_EQ(pMap.count(), 0u);
+  }
+}
@@ -0,0 +1,178 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *   threads.cc
+ *
+ *  Description:
+ *   Multi-threaded tests of the pointer mapper utility header
+ *
+ **************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <CL/sycl.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "legacy_pointer.hpp"
+
+using sycl_acc_target = cl::sycl::access::target;
+const sycl_acc_target sycl_acc_host = sycl_acc_target::host_buffer;
+
+using sycl_acc_mode = cl::sycl::access::mode;
+const sycl_acc_mode sycl_acc_rw = sycl_acc_mode::read_write;
+
+using namespace codeplay;
+
+using buffer_id = legacy::PointerMapper::buffer_id;
+using buffer_t = legacy::PointerMapper::buffer_t;
+
+static unsigned number_threads() {
+  unsigned n = std::thread::hardware_concurrency();
+  return std::min(std::max(n, 4u), 16u);
+}
+
+/* Runs f(threadId) on the given number of threads, starting
+ * all of them at the same time.
+ */
+template <typename F>
+static void run_threads(unsigned numThreads, F f) {
+  std::atomic<unsigned> ready{0};
+  std::vector<std::thread> threads;
+  for (unsigned t = 0; t < numThreads; t++) {
+    threads.emplace_back([&ready, numThreads, f, t]() {
+      ready++;
+      while (ready.load() < numThreads) {
+        std::this_thread::yield();
+      }
+      f(t);
+    });
+  }
+  for (auto &th : threads) {
+    th.join();
+  }
+}
+
+TEST(threads, unique_ids) {
+  const unsigned numThreads = number_threads();
+  const unsigned perThread = 500;
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+
+  std::vector<std::vector<void *>> ptrs(numThreads);
+  run_threads(numThreads, [&ptrs, perThread](unsigned t) {
+    for (unsigned i = 0; i < perThread; i++) {
+      ptrs[t].push_back(legacy::malloc(sizeof(float)));
+    }
+  });
+  ASSERT_EQ(legacy::getPointerMapper().count(), numThreads * perThread);
+
+  std::vector<buffer_id> ids;
+  for (auto &v : ptrs) {
+    for (void *ptr : v) {
+      ASSERT_FALSE(legacy::PointerMapper::is_nullptr(ptr));
+      ids.push_back(legacy::getPointerMapper().get_buffer_id(ptr));
+    }
+  }
+  std::sort(ids.begin(), ids.end());
+  ASSERT_EQ(std::unique(ids.begin(), ids.end()), ids.end());
+
+  // Free the pointers on a different thread from the one that
+  // allocated them
+  run_threads(numThreads, [&ptrs, numThreads](unsigned t) {
+    for (void *ptr : ptrs[(t + 1) % numThreads]) {
+      legacy::free(ptr);
+    }
+  });
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+}
+
+TEST(threads, stress) {
+  const unsigned numThreads = number_threads();
+  const unsigned iterations = 20000;
+  const unsigned window = 16;
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+
+  std::atomic<unsigned> errors{0};
+  run_threads(numThreads, [&errors, iterations, window](unsigned t) {
+    std::vector<void *> live;
+    for (unsigned i = 0; i < iterations; i++) {
+      // The size and the first byte identify the owner of the buffer
+      size_t size = 1 + (i % window);
+      void *ptr = legacy::malloc(size);
+      auto &pMap = legacy::getPointerMapper();
+      try {
+        buffer_t &b = pMap.get_buffer(pMap.get_buffer_id(ptr));
+        b.get_access<sycl_acc_rw, sycl_acc_host>()[0] =
+            static_cast<uint8_t>(t);
+      } catch (std::out_of_range &) {
+        errors++;
+      }
+      live.push_back(ptr);
+      if (live.size() == window) {
+        // Release in a different order from the allocations
+        for (unsigned j = 0; j < window; j++) {
+          void *p = live[(j * 7) % window];
+          try {
+            buffer_t &b = pMap.get_buffer(pMap.get_buffer_id(p));
+            if (b.get_access<sycl_acc_rw, sycl_acc_host>()[0] != t) {
+              errors++;
+            }
+          } catch (std::out_of_range &) {
+            errors++;
+          }
+          legacy::free(p);
+        }
+        live.clear();
+      }
+    }
+    for (void *p : live) {
+      legacy::free(p);
+    }
+  });
+  ASSERT_EQ(errors.load(), 0u);
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+}
+
+TEST(threads, throughput) {
+  const unsigned iterations = 200000;
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+
+  for (unsigned numThreads : {1u, number_threads()}) {
+    auto start = std::chrono::steady_clock::now();
+    run_threads(numThreads, [iterations](unsigned) {
+      auto &pMap = legacy::getPointerMapper();
+      for (unsigned i = 0; i < iterations; i++) {
+        void *ptr = legacy::malloc(sizeof(float));
+        pMap.get_buffer(pMap.get_buffer_id(ptr));
+        legacy::free(ptr);
+      }
+    });
+    std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    std::cout << numThreads << " threads: "
+              << (numThreads * iterations) / elapsed.count()
+              << " malloc/free per second" << std::endl;
+  }
+  ASSERT_EQ(legacy::getPointerMapper().count(), 0u);
+}
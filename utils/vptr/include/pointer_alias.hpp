@@ -22,7 +22,7 @@
  *
  *  Description:
  *    Alias functions that obtain a pointer of the given type from an
- *    accessor.
+ *    accessor, or a view of its contents as SYCL vectors.
  *
  * Authors:
  *
@@ -33,6 +33,9 @@
 
 #include <CL/sycl.hpp>
 
+#include <cstdint>
+#include <stdexcept>
+
 #ifndef CL_SYCL_POINTER_ALIAS
 #define CL_SYCL_POINTER_ALIAS
 
@@ -51,6 +54,141 @@ T * get_host_ptr_as(AccessorT& acc) {
      return reinterpret_cast<T *>(&(acc.get_pointer()[0]));
 }
 
+/**
+ * vec_view
+ *  View of count elements of type T as vectors of N elements.
+ *  Whether the memory is aligned to the size of the vector is checked
+ *  when the view is created: aligned views load and store whole
+ *  vectors, the others use vload/vstore (vec::load and vec::store),
+ *  which only need the alignment of T.
+ *  The last count % N elements (the tail) do not fill a vector,
+ *  and are accessed with load_tail/store_tail.
+ */
+template <typename T, int N, cl::sycl::access::address_space Space =
+                                 cl::sycl::access::address_space::global_space>
+class vec_view {
+  static_assert(N == 2 || N == 4 || N == 8 || N == 16,
+                "vec_view supports vectors of 2, 4, 8 or 16 elements");
+
+ public:
+  using vec_t = cl::sycl::vec<T, N>;
+  using multi_ptr_t = cl::sycl::multi_ptr<T, Space>;
+  using vec_pointer_t = typename cl::sycl::multi_ptr<vec_t, Space>::pointer_t;
+
+  vec_view(multi_ptr_t ptr, size_t count)
+      : m_ptr(ptr),
+        m_count(count),
+        m_aligned(reinterpret_cast<uintptr_t>(ptr.get()) % sizeof(vec_t) ==
+                  0) {}
+
+  /* Number of whole vectors in the view
+   */
+  size_t size() const { return m_count / N; }
+
+  /* Number of elements after the last whole vector
+   */
+  size_t tail_size() const { return m_count % N; }
+
+  /* Number of elements of type T in the view
+   */
+  size_t get_count() const { return m_count; }
+
+  bool is_aligned() const { return m_aligned; }
+
+  multi_ptr_t get_pointer() const { return m_ptr; }
+
+  /* load.
+   * Loads the i-th vector of the view
+   */
+  vec_t load(size_t i) const {
+    if (m_aligned) {
+      return reinterpret_cast<vec_pointer_t>(m_ptr.get())[i];
+    }
+    vec_t v;
+    v.load(i, m_ptr);
+    return v;
+  }
+
+  /* store.
+   * Stores v as the i-th vector of the view
+   */
+  void store(size_t i, const vec_t &v) const {
+    if (m_aligned) {
+      reinterpret_cast<vec_pointer_t>(m_ptr.get())[i] = v;
+    } else {
+      v.store(i, m_ptr);
+    }
+  }
+
+  /* load_tail.
+   * Loads the tail of the view in the first elements of a vector,
+   * the other elements are zero.
+   */
+  vec_t load_tail() const {
+    T tmp[N];
+    size_t base = size() * N;
+    for (int j = 0; j < N; j++) {
+      tmp[j] = (static_cast<size_t>(j) < tail_size()) ? m_ptr[base + j] : T(0);
+    }
+    vec_t v;
+    v.load(0, cl::sycl::multi_ptr<T, cl::sycl::access::address_space::
+                                          private_space>(tmp));
+    return v;
+  }
+
+  /* store_tail.
+   * Stores the first elements of v in the tail of the view.
+   */
+  void store_tail(const vec_t &v) const {
+    T tmp[N];
+    v.store(0, cl::sycl::multi_ptr<T, cl::sycl::access::address_space::
+                                           private_space>(tmp));
+    size_t base = size() * N;
+    for (size_t j = 0; j < tail_size(); j++) {
+      m_ptr[base + j] = tmp[j];
+    }
+  }
+
+ private:
+  multi_ptr_t m_ptr;
+  size_t m_count;
+  bool m_aligned;
+};
+
+/**
+ * get_device_vec_view
+ *  View of the contents of a device accessor as vectors of N elements
+ *  of type T, starting offset bytes after the beginning of the accessor.
+ *  Kernels cannot throw, so an offset past the end of the accessor
+ *  gives an empty view.
+ */
+template <typename T, int N, typename AccessorT>
+vec_view<T, N> get_device_vec_view(AccessorT &acc, size_t offset = 0) {
+  size_t numBytes = acc.get_count() * sizeof(acc[0]);
+  offset = (offset < numBytes) ? offset : numBytes;
+  auto ptr = reinterpret_cast<typename cl::sycl::global_ptr<T>::pointer_t>(
+      &(acc.get_pointer()[0]) + offset);
+  return vec_view<T, N>(cl::sycl::global_ptr<T>(ptr),
+                        (numBytes - offset) / sizeof(T));
+}
+
+/**
+ * get_host_vec_view
+ *  View of the contents of a host accessor as vectors of N elements
+ *  of type T, starting offset bytes after the beginning of the accessor.
+ * \throw std::out_of_range if the offset is past the end of the accessor
+ */
+template <typename T, int N, typename AccessorT>
+vec_view<T, N> get_host_vec_view(AccessorT &acc, size_t offset = 0) {
+  size_t numBytes = acc.get_count() * sizeof(acc[0]);
+  if (offset > numBytes) {
+    throw std::out_of_range("The offset of the view is past the accessor");
+  }
+  T *ptr = reinterpret_cast<T *>(&(acc.get_pointer()[0]) + offset);
+  return vec_view<T, N>(cl::sycl::global_ptr<T>(ptr),
+                        (numBytes - offset) / sizeof(T));
+}
+
 }  // codeplay
 }  // sycl
 }  // cl
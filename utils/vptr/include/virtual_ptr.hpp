@@ -32,8 +32,15 @@
 
 #include <CL/sycl.hpp>
 
+#include <algorithm>
+#include <iterator>
+#include <memory>
 #include <queue>
+#include <set>
+#include <stdexcept>
+#include <type_traits>
 #include <unordered_map>
+#include <vector>
 
 namespace cl {
 namespace sycl {
@@ -43,6 +50,253 @@ using buffer_data_type = uint8_t;
 using sycl_acc_target = cl::sycl::access::target;
 using sycl_acc_mode = cl::sycl::access::mode;
 
+/**
+ * Usage hints for virtual allocations.
+ * The hint given to SYCLmalloc selects the allocator of the buffers
+ * and whether their contents are written back when they are destroyed.
+ */
+enum class alloc_hint {
+  /* Data is only produced and consumed by kernels */
+  device_only,
+  /* Data written by kernels is read back on the host */
+  host_readback,
+  /* Data is written once on the host and then read by many kernels */
+  read_mostly
+};
+
+/**
+ * sorted_flat_map
+ *  Ordered map stored as a contiguous array of sorted keys and a
+ *  parallel array of pointers to the values.
+ *  Lookups only touch the array of keys, which is much more cache
+ *  friendly than the nodes of a tree.
+ *  Both arrays keep a gap of unused elements at the position of the
+ *  last insertion or removal, so consecutive changes in the same area
+ *  of the address space (e.g. freeing pointers in allocation order)
+ *  only move a few elements.
+ *  Values live in separate storage, so references to them stay valid
+ *  until they are erased. Iterators are logical positions in the map,
+ *  so they stay valid across insertions and removals after them.
+ */
+template <typename key_t, typename value_t>
+class sorted_flat_map {
+ public:
+  /**
+   * Reference to an element, with the same members as the
+   * std::pair of a std::map.
+   */
+  struct element_ref {
+    const key_t first;
+    value_t &second;
+  };
+
+  /**
+   * Result of the arrow operator of the iterator, since elements
+   * are not stored as pairs there is no object to point to.
+   */
+  struct element_ptr {
+    element_ref m_ref;
+    element_ref *operator->() { return &m_ref; }
+  };
+
+  class iterator {
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = element_ref;
+    using difference_type = std::ptrdiff_t;
+    using pointer = element_ptr;
+    using reference = element_ref;
+
+    iterator() : m_map{nullptr}, m_pos{0} {}
+    iterator(sorted_flat_map *map, size_t pos) : m_map{map}, m_pos{pos} {}
+
+    reference operator*() const {
+      return element_ref{m_map->key_at(m_pos), m_map->value_at(m_pos)};
+    }
+    pointer operator->() const { return element_ptr{**this}; }
+
+    iterator &operator++() {
+      ++m_pos;
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator tmp = *this;
+      ++m_pos;
+      return tmp;
+    }
+    iterator &operator--() {
+      --m_pos;
+      return *this;
+    }
+    iterator operator--(int) {
+      iterator tmp = *this;
+      --m_pos;
+      return tmp;
+    }
+
+    bool operator==(const iterator &rhs) const {
+      return (m_map == rhs.m_map) && (m_pos == rhs.m_pos);
+    }
+    bool operator!=(const iterator &rhs) const { return !(*this == rhs); }
+
+    size_t position() const { return m_pos; }
+
+   private:
+    sorted_flat_map *m_map;
+    size_t m_pos;
+  };
+
+  sorted_flat_map() : m_keys{}, m_values{}, m_gapBegin{0}, m_gapEnd{0} {}
+
+  iterator begin() { return iterator{this, 0}; }
+  iterator end() { return iterator{this, size()}; }
+
+  size_t size() const { return m_keys.size() - gap_size(); }
+  bool empty() const { return (size() == 0); }
+
+  void clear() {
+    m_keys.clear();
+    m_values.clear();
+    m_gapBegin = 0;
+    m_gapEnd = 0;
+  }
+
+  /**
+   * Returns the first element whose key is not smaller than the given one.
+   */
+  iterator lower_bound(const key_t &key) {
+    return iterator{this, lower_bound_position(key)};
+  }
+
+  /**
+   * Returns the element with the given key, or end() if there is none.
+   */
+  iterator find(const key_t &key) {
+    auto pos = lower_bound_position(key);
+    if (pos == size() || !(key_at(pos) == key)) {
+      return end();
+    }
+    return iterator{this, pos};
+  }
+
+  /**
+   * Inserts the value with the given key if the key is not in the map.
+   * Returns the element with the key, and whether it was inserted.
+   */
+  std::pair<iterator, bool> emplace(const key_t &key, const value_t &value) {
+    auto pos = lower_bound_position(key);
+    if (pos < size() && key_at(pos) == key) {
+      return std::make_pair(iterator{this, pos}, false);
+    }
+    if (gap_size() == 0) {
+      grow(key);
+    }
+    move_gap(pos);
+    m_keys[m_gapBegin] = key;
+    m_values[m_gapBegin].reset(new value_t(value));
+    ++m_gapBegin;
+    return std::make_pair(iterator{this, pos}, true);
+  }
+
+  void erase(iterator it) {
+    move_gap(it.position());
+    m_values[m_gapEnd].reset();
+    ++m_gapEnd;
+  }
+
+ private:
+  size_t gap_size() const { return m_gapEnd - m_gapBegin; }
+
+  /**
+   * Position in the arrays of the element at the given position
+   * of the map.
+   */
+  size_t physical(size_t pos) const {
+    return (pos < m_gapBegin) ? pos : (pos + gap_size());
+  }
+
+  const key_t &key_at(size_t pos) const { return m_keys[physical(pos)]; }
+
+  value_t &value_at(size_t pos) { return *m_values[physical(pos)]; }
+
+  /**
+   * Branch-free binary search over a contiguous range of keys.
+   * The comparison only selects the next base, so the compiler can
+   * use a conditional move instead of a hard to predict branch.
+   */
+  static size_t search(const key_t *first, size_t len, const key_t &key) {
+    if (len == 0) {
+      return 0;
+    }
+    const key_t *base = first;
+    while (len > 1) {
+      size_t half = len / 2;
+      base = (base[half - 1] < key) ? base + half : base;
+      len -= half;
+    }
+    return (base - first) + ((*base < key) ? 1 : 0);
+  }
+
+  /**
+   * Position of the first key not smaller than the given one.
+   * Only one of the two ranges of keys around the gap is searched.
+   */
+  size_t lower_bound_position(const key_t &key) const {
+    if (m_gapBegin > 0 && !(m_keys[m_gapBegin - 1] < key)) {
+      return search(m_keys.data(), m_gapBegin, key);
+    }
+    return m_gapBegin + search(m_keys.data() + m_gapEnd,
+                               m_keys.size() - m_gapEnd, key);
+  }
+
+  /**
+   * Moves the gap so it starts at the given position of the map.
+   */
+  void move_gap(size_t pos) {
+    if (gap_size() == 0) {
+      m_gapBegin = pos;
+      m_gapEnd = pos;
+    } else if (pos < m_gapBegin) {
+      auto num = m_gapBegin - pos;
+      std::move_backward(m_keys.begin() + pos, m_keys.begin() + m_gapBegin,
+                         m_keys.begin() + m_gapEnd);
+      std::move_backward(m_values.begin() + pos,
+                         m_values.begin() + m_gapBegin,
+                         m_values.begin() + m_gapEnd);
+      m_gapBegin -= num;
+      m_gapEnd -= num;
+    } else if (pos > m_gapBegin) {
+      auto num = pos - m_gapBegin;
+      std::move(m_keys.begin() + m_gapEnd, m_keys.begin() + m_gapEnd + num,
+                m_keys.begin() + m_gapBegin);
+      std::move(m_values.begin() + m_gapEnd,
+                m_values.begin() + m_gapEnd + num,
+                m_values.begin() + m_gapBegin);
+      m_gapBegin += num;
+      m_gapEnd += num;
+    }
+  }
+
+  /**
+   * Doubles the storage, leaving the new gap at the end.
+   * \param fill Key used to fill the new elements of the gap
+   */
+  void grow(const key_t &fill) {
+    auto num = size();
+    move_gap(num);
+    auto capacity = std::max<size_t>(16, 2 * num);
+    m_keys.resize(capacity, fill);
+    m_values.resize(capacity);
+    m_gapEnd = capacity;
+  }
+
+  std::vector<key_t> m_keys;
+  std::vector<std::unique_ptr<value_t> > m_values;
+  /* Unused elements of the arrays are [m_gapBegin, m_gapEnd) */
+  size_t m_gapBegin;
+  size_t m_gapEnd;
+};
+
 /**
  * PointerMapper
  *  Associates fake pointers with buffers.
@@ -77,7 +331,7 @@ class PointerMapper {
      * Add a certain value to the pointer to create a
      * new pointer to that offset
      */
-    virtual_pointer_t operator+(size_t off) { return m_contents + off; }
+    virtual_pointer_t operator+(size_t off) const { return m_contents + off; }
 
     /**
      * Numerical order for sorting pointers in containers.
@@ -134,27 +388,73 @@ class PointerMapper {
    */
   using buffer_t = cl::sycl::buffer_mem;
 
+  /* Creates a buffer of the given size in bytes with the allocator
+   * of an allocation, so the private copies of shared buffers keep it.
+   */
+  using buffer_factory_t = buffer_t (*)(size_t);
+
+  template <typename buffer_allocator>
+  static buffer_t make_buffer(size_t size) {
+    return cl::sycl::buffer<buffer_data_type, 1, buffer_allocator>(
+        cl::sycl::range<1>{size});
+  }
+
+  /* State shared by the nodes of clones that hold the same buffer.
+   * The queue is where the buffer is copied when one of them is written.
+   */
+  struct cow_state_t {
+    cl::sycl::queue m_queue;
+  };
+
   /**
    * Node that stores information about a device allocation.
-   * Nodes are sorted by size to organise a free list of nodes
-   * that can be recovered.
+   * Nodes are indexed by their address. The free nodes that can be
+   * recovered are listed by address too, so an allocation takes the
+   * first free node, in address order, that is large enough.
+   * Allocations larger than the maximum chunk size are split in several
+   * consecutive nodes; all but the first one are marked as continuation.
+   * Nodes created by SYCLclone share the buffer with the original node
+   * until one of them is written, all of them hold the same copy-on-write
+   * token.
    */
   struct pMapNode_t {
     buffer_t m_buffer;
     size_t m_size;
     bool m_free;
+    bool m_continuation;
+    alloc_hint m_hint;
+    buffer_factory_t m_makeBuffer;
+    std::shared_ptr<cow_state_t> m_cowToken;
 
-    pMapNode_t(buffer_t b, size_t size, bool f)
-        : m_buffer{b}, m_size{size}, m_free{f} {
-      m_buffer.set_final_data(nullptr);
+    pMapNode_t(buffer_t b, size_t size, bool f, bool c = false,
+               alloc_hint h = alloc_hint::device_only,
+               buffer_factory_t makeBuffer = &make_buffer<
+                   cl::sycl::default_allocator<buffer_data_type> >)
+        : m_buffer{b},
+          m_size{size},
+          m_free{f},
+          m_continuation{c},
+          m_hint{h},
+          m_makeBuffer{makeBuffer} {
+      apply_hint();
+    }
+
+    /**
+     * Only buffers whose data is read back on the host keep
+     * their final data, the rest are never copied back.
+     */
+    void apply_hint() {
+      if (m_hint != alloc_hint::host_readback) {
+        m_buffer.set_final_data(nullptr);
+      }
     }
 
     bool operator<=(const pMapNode_t &rhs) { return (m_size <= rhs.m_size); }
   };
 
-  /** Storage of the pointer / buffer tree
+  /** Storage of the pointer / buffer index
    */
-  using pointerMap_t = std::map<virtual_pointer_t, pMapNode_t>;
+  using pointerMap_t = sorted_flat_map<virtual_pointer_t, pMapNode_t>;
 
   /**
    * Obtain the insertion point in the pointer map for
@@ -166,12 +466,13 @@ class PointerMapper {
     bool reuse = false;
     if (!m_freeList.empty()) {
       // try to re-use an existing block
-      for (auto freeElem : m_freeList) {
+      for (auto freePtr : m_freeList) {
+        auto freeElem = m_pointerMap.find(freePtr);
         if (freeElem->second.m_size >= requiredSize) {
           retVal = freeElem;
           reuse = true;
           // Element is not going to be free anymore
-          m_freeList.erase(freeElem);
+          m_freeList.erase(freePtr);
           break;
         }
       }
@@ -201,7 +502,7 @@ class PointerMapper {
     auto node = m_pointerMap.lower_bound(ptr);
     // If the value of the pointer is not the one of the node
     // then we return the previous one
-    if (node->first != ptr) {
+    if (node == std::end(m_pointerMap) || node->first != ptr) {
       if (node == std::begin(m_pointerMap)) {
         throw std::out_of_range("The pointer is not registered in the map");
       }
@@ -215,15 +516,7 @@ class PointerMapper {
    */
   cl::sycl::buffer<buffer_data_type, 1, cl::sycl::detail::base_allocator>
   get_buffer(const virtual_pointer_t ptr) {
-    using buffer_t =
-        cl::sycl::buffer<buffer_data_type, 1, cl::sycl::detail::base_allocator>;
-
-    // get_node() returns a `buffer_mem`, so we need to cast it to a `buffer<>`.
-    // We can do this without the `buffer_mem` being a pointer, as we
-    // only declare member variables in the base class (`buffer_mem`) and not in
-    // the child class (`buffer<>).
-    buffer_t buf(*(static_cast<buffer_t *>(&get_node(ptr)->second.m_buffer)));
-    return buf;
+    return as_typed_buffer(get_node(ptr)->second.m_buffer);
   }
 
   /**
@@ -236,24 +529,84 @@ class PointerMapper {
             sycl_acc_target access_target = sycl_acc_target::global_buffer>
   cl::sycl::accessor<buffer_data_type, 1, access_mode, access_target>
   get_access(const virtual_pointer_t ptr) {
+    if (access_mode != sycl_acc_mode::read) {
+      detach_shared(ptr, is_discard_mode(access_mode));
+    }
     return get_buffer(ptr).get_access<access_mode, access_target>();
   }
 
   /**
    * @brief Returns an accessor to the buffer of the given virtual pointer
    *        in the given command group scope
+   *
+   * No command group can be submitted from inside another one, so a
+   * buffer shared with a clone must be detached with detach_shared
+   * before the command group that writes it, unless the mode
+   * discards the contents.
+   *
    * @param accessMode
    * @param accessTarget
    * @param ptr The virtual pointer
    * @param cgh Reference to the command group scope
+   * @throw std::logic_error if the buffer is shared and the mode keeps
+   *        its contents
    */
   template <sycl_acc_mode access_mode,
             sycl_acc_target access_target = sycl_acc_target::global_buffer>
   cl::sycl::accessor<buffer_data_type, 1, access_mode, access_target>
   get_access(const virtual_pointer_t ptr, cl::sycl::handler &cgh) {
+    if (access_mode != sycl_acc_mode::read) {
+      if (!is_discard_mode(access_mode) && is_shared(ptr)) {
+        throw std::logic_error(
+            "A shared buffer must be detached before the command group");
+      }
+      detach_shared(ptr, is_discard_mode(access_mode));
+    }
     return get_buffer(ptr).get_access<access_mode, access_target>(cgh);
   }
 
+  /**
+   * Whether the buffer that holds the given virtual pointer is shared
+   * with a clone.
+   */
+  bool is_shared(const virtual_pointer_t ptr) {
+    auto &token = get_node(ptr)->second.m_cowToken;
+    return (token && token.use_count() > 1);
+  }
+
+  /**
+   * @brief Gives the node that holds the given virtual pointer a
+   *        private buffer if it shares it with a clone.
+   *
+   * The private buffer is created with the allocator of the allocation
+   * and keeps its hint. The contents are copied by a command group
+   * submitted to the queue given to SYCLclone, so they stay on the
+   * device. This must not be called from inside a command group unless
+   * the contents are discarded.
+   *
+   * @param ptr The virtual pointer
+   * @param discardContents Whether the current contents can be dropped
+   */
+  void detach_shared(const virtual_pointer_t ptr,
+                     bool discardContents = false) {
+    if (!is_shared(ptr)) {
+      return;
+    }
+    auto &node = get_node(ptr)->second;
+    buffer_t privateBuffer = node.m_makeBuffer(node.m_size);
+    if (!discardContents) {
+      auto src = as_typed_buffer(node.m_buffer);
+      auto dst = as_typed_buffer(privateBuffer);
+      node.m_cowToken->m_queue.submit([&](cl::sycl::handler &cgh) {
+        cgh.copy(src.get_access<sycl_acc_mode::read>(cgh),
+                 dst.get_access<sycl_acc_mode::discard_write>(cgh));
+      });
+    }
+    node.m_buffer = privateBuffer;
+    node.m_cowToken.reset();
+    node.apply_hint();
+  }
+
   /*
    * Returns the offset from the base address of this pointer.
    */
@@ -265,8 +618,23 @@ class PointerMapper {
 
   /**
    * Constructs the PointerMapper structure.
+   * \param maxChunkSize Maximum size in bytes of a single buffer,
+   *        larger allocations are split in chunks. Zero means no limit.
+   */
+  explicit PointerMapper(size_t maxChunkSize = 0)
+      : m_pointerMap{},
+        m_freeList{},
+        m_maxChunkSize{maxChunkSize},
+        m_chunkCount{0} {};
+
+  /**
+   * Constructs the PointerMapper structure, limiting the size of
+   * each buffer to the maximum allocation size of the given device.
+   * \param dev Device where the buffers will be used
    */
-  PointerMapper() : m_pointerMap{}, m_freeList{} {};
+  explicit PointerMapper(const cl::sycl::device &dev)
+      : PointerMapper(
+            dev.get_info<cl::sycl::info::device::max_mem_alloc_size>()){};
 
   /**
    * PointerMapper cannot be copied or moved
@@ -279,15 +647,32 @@ class PointerMapper {
   inline void clear() {
     m_freeList.clear();
     m_pointerMap.clear();
+    m_chunkCount = 0;
+  }
+
+  /**
+   * Maximum size in bytes of a single buffer, zero if there is no limit.
+   */
+  size_t get_max_chunk_size() const { return m_maxChunkSize; }
+
+  /**
+   * Sets the maximum size in bytes of a single buffer.
+   * Only affects allocations performed after the call.
+   */
+  void set_max_chunk_size(size_t maxChunkSize) {
+    m_maxChunkSize = maxChunkSize;
   }
 
   /* add_pointer.
    * Adds a pointer to the map and returns the virtual pointer id.
    */
-  virtual_pointer_t add_pointer(buffer_t &&b) {
+  virtual_pointer_t add_pointer(
+      buffer_t &&b, alloc_hint hint = alloc_hint::device_only,
+      buffer_factory_t makeBuffer =
+          &make_buffer<cl::sycl::default_allocator<buffer_data_type> >) {
     virtual_pointer_t retVal = nullptr;
     size_t bufSize = b.get_count();
-    pMapNode_t p{b, bufSize, false};
+    pMapNode_t p{b, bufSize, false, false, hint, makeBuffer};
     // If this is the first pointer:
     if (m_pointerMap.empty()) {
       virtual_pointer_t initialVal{1};
@@ -299,6 +684,10 @@ class PointerMapper {
     if (lastElemIter->second.m_free) {
       lastElemIter->second.m_buffer = b;
       lastElemIter->second.m_free = false;
+      lastElemIter->second.m_continuation = false;
+      lastElemIter->second.m_hint = hint;
+      lastElemIter->second.m_makeBuffer = makeBuffer;
+      lastElemIter->second.apply_hint();
 
       // If the recovered node is bigger than the inserted one
       // add a new free node with the remaining space
@@ -312,8 +701,8 @@ class PointerMapper {
 
         // add the new free node
         auto newFreePtr = lastElemIter->first + bufSize;
-        auto freeNode = m_pointerMap.emplace(newFreePtr, p2).first;
-        m_freeList.emplace(freeNode);
+        m_pointerMap.emplace(newFreePtr, p2);
+        m_freeList.emplace(newFreePtr);
       }
 
       retVal = lastElemIter->first;
@@ -325,6 +714,111 @@ class PointerMapper {
     return retVal;
   }
 
+  /* add_chunked_pointer.
+   * Adds a list of buffers that together back a single allocation.
+   * The buffers are placed on consecutive virtual addresses at the end
+   * of the address space, so pointer arithmetic over the whole
+   * allocation resolves to the right chunk.
+   */
+  virtual_pointer_t add_chunked_pointer(
+      std::vector<buffer_t> &&chunks,
+      alloc_hint hint = alloc_hint::device_only,
+      buffer_factory_t makeBuffer =
+          &make_buffer<cl::sycl::default_allocator<buffer_data_type> >) {
+    if (chunks.size() == 1) {
+      return add_pointer(std::move(chunks.front()), hint, makeBuffer);
+    }
+    virtual_pointer_t retVal{1};
+    if (!m_pointerMap.empty()) {
+      auto lastElemIter = std::prev(m_pointerMap.end());
+      retVal = lastElemIter->first + lastElemIter->second.m_size;
+    }
+    virtual_pointer_t current = retVal;
+    bool continuation = false;
+    for (auto &chunk : chunks) {
+      size_t chunkSize = chunk.get_count();
+      pMapNode_t p{chunk, chunkSize, false, continuation, hint, makeBuffer};
+      m_pointerMap.emplace(current, p);
+      current = current + chunkSize;
+      if (continuation) {
+        m_chunkCount++;
+      }
+      continuation = true;
+    }
+    return retVal;
+  }
+
+  /* clone_pointer.
+   * Adds a new allocation that shares the buffers of the allocation
+   * starting at the given virtual pointer. The buffers are copied on
+   * the given queue when either of the allocations is written, unless
+   * they are already shared, in which case they keep the queue of the
+   * first clone.
+   */
+  virtual_pointer_t clone_pointer(const virtual_pointer_t ptr,
+                                  cl::sycl::queue &q) {
+    auto node = get_node(ptr);
+    if (node->first != ptr || node->second.m_free ||
+        node->second.m_continuation) {
+      throw std::out_of_range("The pointer is not the start of an allocation");
+    }
+    std::vector<buffer_t> chunks;
+    std::vector<std::shared_ptr<cow_state_t> > tokens;
+    auto hint = node->second.m_hint;
+    auto makeBuffer = node->second.m_makeBuffer;
+    do {
+      auto &token = node->second.m_cowToken;
+      if (!token) {
+        token = std::make_shared<cow_state_t>(cow_state_t{q});
+      }
+      chunks.push_back(node->second.m_buffer);
+      tokens.push_back(token);
+      ++node;
+    } while (node != m_pointerMap.end() && node->second.m_continuation);
+
+    auto retVal = add_chunked_pointer(std::move(chunks), hint, makeBuffer);
+    auto clone = get_node(retVal);
+    for (auto &token : tokens) {
+      clone->second.m_cowToken = token;
+      ++clone;
+    }
+    return retVal;
+  }
+
+  /**
+   * @brief Calls the given function for each of the chunks that back
+   *        the range [ptr, ptr + numBytes).
+   *
+   * The function is called with the buffer of the chunk, the offset
+   * in bytes inside the buffer, the number of bytes of the range stored
+   * in this chunk and the offset in bytes from ptr.
+   * Kernels or copies over large allocations can use this to be split
+   * at chunk boundaries.
+   *
+   * \param ptr Virtual pointer to the start of the range
+   * \param numBytes Size in bytes of the range
+   * \param f Function to call for each chunk
+   * \throws std::out_of_range if the range exceeds the allocation
+   */
+  template <typename Func>
+  void for_each_chunk(const virtual_pointer_t ptr, size_t numBytes, Func f) {
+    size_t done = 0;
+    while (done < numBytes) {
+      auto current = ptr + done;
+      auto node = get_node(current);
+      if (node->second.m_free || (done > 0 && !node->second.m_continuation)) {
+        throw std::out_of_range("The range exceeds the allocation");
+      }
+      size_t offset = current - node->first;
+      if (offset >= node->second.m_size) {
+        throw std::out_of_range("The range exceeds the allocation");
+      }
+      size_t bytes = std::min(node->second.m_size - offset, numBytes - done);
+      f(get_buffer(current), offset, bytes, done);
+      done += bytes;
+    }
+  }
+
   /**
    * @brief Fuses the given node with the previous nodes in the
    *        pointer map if they are free
@@ -340,7 +834,7 @@ class PointerMapper {
         break;
       }
       auto fwd_size = fwd_node->second.m_size;
-      m_freeList.erase(fwd_node);
+      m_freeList.erase(fwd_node->first);
       m_pointerMap.erase(fwd_node);
 
       node->second.m_size += fwd_size;
@@ -364,7 +858,7 @@ class PointerMapper {
       prev_node->second.m_size += node->second.m_size;
 
       // remove the current node
-      m_freeList.erase(node);
+      m_freeList.erase(node->first);
       m_pointerMap.erase(node);
 
       // point to the previous node
@@ -378,8 +872,21 @@ class PointerMapper {
   void remove_pointer(const virtual_pointer_t ptr) {
     auto node = this->get_node(ptr);
 
+    // Release the remaining chunks of a chunked allocation, they
+    // are fused with the first one below
+    auto chunk = std::next(node);
+    while (chunk != m_pointerMap.end() && chunk->second.m_continuation) {
+      chunk->second.m_continuation = false;
+      chunk->second.m_free = true;
+      chunk->second.m_cowToken.reset();
+      m_freeList.emplace(chunk->first);
+      m_chunkCount--;
+      ++chunk;
+    }
+
     node->second.m_free = true;
-    m_freeList.emplace(node);
+    node->second.m_cowToken.reset();
+    m_freeList.emplace(node->first);
 
     // Fuse the node
     // with free nodes before and after it
@@ -389,7 +896,7 @@ class PointerMapper {
     // If after fusing the node is the last one
     // simply remove it (since it is free)
     if (node == std::prev(m_pointerMap.end())) {
-      m_freeList.erase(node);
+      m_freeList.erase(node->first);
       m_pointerMap.erase(node);
     }
   }
@@ -398,45 +905,154 @@ class PointerMapper {
    * Return the number of active pointers (i.e, pointers that
    * have been malloc but not freed).
    */
-  size_t count() const { return (m_pointerMap.size() - m_freeList.size()); }
+  size_t count() const {
+    return (m_pointerMap.size() - m_freeList.size() - m_chunkCount);
+  }
 
  private:
+  /* Views a buffer of the map as a buffer of bytes.
+   * The nodes hold a `buffer_mem`, so we need to cast it to a `buffer<>`.
+   * We can do this without the `buffer_mem` being a pointer, as we
+   * only declare member variables in the base class (`buffer_mem`) and not
+   * in the child class (`buffer<>`).
+   */
+  static cl::sycl::buffer<buffer_data_type, 1,
+                          cl::sycl::detail::base_allocator>
+  as_typed_buffer(buffer_t &b) {
+    using typed_buffer_t =
+        cl::sycl::buffer<buffer_data_type, 1, cl::sycl::detail::base_allocator>;
+    return typed_buffer_t(*(static_cast<typed_buffer_t *>(&b)));
+  }
+
   /**
-   * Compare two iterators to pointer map entries according to
-   * the size of the allocation on the device.
+   * Whether an accessor of the given mode does not need the
+   * current contents of the buffer.
    */
-  struct SortBySize {
-    bool operator()(typename pointerMap_t::iterator a,
-                    typename pointerMap_t::iterator b) {
-      return ((a->first < b->first) && (a->second <= b->second)) ||
-             ((a->first < b->first) && (b->second <= a->second));
-    }
-  };
+  static constexpr bool is_discard_mode(sycl_acc_mode mode) {
+    return (mode == sycl_acc_mode::discard_write ||
+            mode == sycl_acc_mode::discard_read_write);
+  }
 
   /* Maps the pointer addresses to buffer and size pairs.
     */
   pointerMap_t m_pointerMap;
 
-  /* List of free nodes available for re-using
+  /* Addresses of the free nodes available for re-using, in address order,
+   * so get_insertion_point is a first-fit search that packs allocations
+   * towards the start of the address space.
+   * Iterators of the pointer map are positions that change when
+   * nodes are inserted or removed, so the addresses are stored.
    */
-  std::set<typename pointerMap_t::iterator, SortBySize> m_freeList;
+  std::set<virtual_pointer_t> m_freeList;
+
+  /* Maximum size of a single buffer, zero means no limit
+   */
+  size_t m_maxChunkSize;
+
+  /* Number of continuation nodes of chunked allocations
+   */
+  size_t m_chunkCount;
 };
 
+namespace detail {
+
+/**
+ * Creates the buffers that back an allocation of the given size
+ * using the given allocator, and adds them to the pointer mapper.
+ */
+template <typename buffer_allocator>
+inline void *malloc_with_allocator(size_t size, PointerMapper &pMap,
+                                   alloc_hint hint) {
+  // Create a generic buffer of the given size
+  using buffer_t = cl::sycl::buffer<buffer_data_type, 1, buffer_allocator>;
+  auto maxChunkSize = pMap.get_max_chunk_size();
+  if (maxChunkSize == 0 || size <= maxChunkSize) {
+    auto thePointer =
+        pMap.add_pointer(buffer_t(cl::sycl::range<1>{size}), hint,
+                         &PointerMapper::make_buffer<buffer_allocator>);
+    // Store the buffer on the global list
+    return static_cast<void *>(thePointer);
+  }
+  std::vector<PointerMapper::buffer_t> chunks;
+  for (size_t done = 0; done < size; done += maxChunkSize) {
+    auto chunkSize = std::min(maxChunkSize, size - done);
+    chunks.emplace_back(buffer_t(cl::sycl::range<1>{chunkSize}));
+  }
+  auto thePointer = pMap.add_chunked_pointer(
+      std::move(chunks), hint, &PointerMapper::make_buffer<buffer_allocator>);
+  return static_cast<void *>(thePointer);
+}
+
+}  // detail
+
 /**
  * Malloc-like interface to the pointer-mapper.
  * Given a size, creates a byte-typed buffer and returns a
  * fake pointer to keep track of it.
+ * If the size is larger than the maximum chunk size of the pointer
+ * mapper, several buffers are created to back the allocation.
+ * When the default allocator is used, allocations hinted as
+ * host_readback or read_mostly use the map_allocator, so the runtime can
+ * share the host memory with the device instead of copying the data back
+ * (host_readback) or staging the initial upload (read_mostly).
  * \param size Size in bytes of the desired allocation
+ * \param hint Expected usage of the allocation
  * \throw cl::sycl::exception if error while creating the buffer
  */
 template <
     typename buffer_allocator = cl::sycl::default_allocator<buffer_data_type> >
-inline void *SYCLmalloc(size_t size, PointerMapper &pMap) {
-  // Create a generic buffer of the given size
-  using buffer_t = cl::sycl::buffer<buffer_data_type, 1, buffer_allocator>;
-  auto thePointer = pMap.add_pointer(buffer_t(cl::sycl::range<1>{size}));
-  // Store the buffer on the global list
-  return static_cast<void *>(thePointer);
+inline void *SYCLmalloc(size_t size, PointerMapper &pMap,
+                        alloc_hint hint = alloc_hint::device_only) {
+  using default_allocator_t = cl::sycl::default_allocator<buffer_data_type>;
+  if ((hint == alloc_hint::host_readback ||
+       hint == alloc_hint::read_mostly) &&
+      std::is_same<buffer_allocator, default_allocator_t>::value) {
+    return detail::malloc_with_allocator<
+        cl::sycl::map_allocator<buffer_data_type> >(size, pMap, hint);
+  }
+  return detail::malloc_with_allocator<buffer_allocator>(size, pMap, hint);
+}
+
+/**
+ * Prefetch-like interface to the pointer mapper.
+ * Submits a command group per chunk that requires the part of the chunk
+ * in the range [ptr, ptr + size) on the device of the given queue, so
+ * the data is transferred before the first kernel that uses it is
+ * scheduled. The accessors are ranged, so prefetching a small range does
+ * not require the rest of a large chunk.
+ * The command groups only read the data, so they do not delay other
+ * kernels that read it.
+ * \param ptr Virtual pointer to the start of the range
+ * \param size Size in bytes of the range
+ * \param q Queue whose device will use the data
+ * \throw std::out_of_range if the range is not allocated
+ */
+inline void SYCLprefetch(const void *ptr, size_t size, cl::sycl::queue &q,
+                         PointerMapper &pMap) {
+  using chunk_buffer_t =
+      cl::sycl::buffer<buffer_data_type, 1, cl::sycl::detail::base_allocator>;
+  pMap.for_each_chunk(ptr, size, [&](chunk_buffer_t chunk, size_t offset,
+                                     size_t bytes, size_t) {
+    q.submit([&](cl::sycl::handler &cgh) {
+      auto acc = chunk.get_access<sycl_acc_mode::read>(
+          cgh, cl::sycl::range<1>{bytes}, cl::sycl::id<1>{offset});
+      cgh.single_task<class vptr_prefetch>([=]() { (void)acc; });
+    });
+  });
+}
+
+/**
+ * Copy-on-write clone of a virtual allocation.
+ * Given a fake-pointer created with the virtual-pointer malloc,
+ * returns a new fake pointer that shares the same buffers.
+ * The data is only copied, on the given queue, when one of the two
+ * pointers is accessed for writing through PointerMapper::get_access
+ * or detached with PointerMapper::detach_shared.
+ * \throw std::out_of_range if ptr is not the start of an allocation
+ */
+inline void *SYCLclone(const void *ptr, PointerMapper &pMap,
+                       cl::sycl::queue &q) {
+  return static_cast<void *>(pMap.clone_pointer(ptr, q));
 }
 
 /**
@@ -120,3 +120,151 @@ TEST(accessor, two_buffers) {
     ASSERT_EQ(pMap.count(), 0u);
   }
 }
+
+TEST(accessor, prefetch) {
+  PointerMapper pMap;
+  {
+    void *myPtr =
+        SYCLmalloc(100 * sizeof(float), pMap, alloc_hint::read_mostly);
+    ASSERT_EQ(pMap.get_node(myPtr)->second.m_hint, alloc_hint::read_mostly);
+
+    {
+      auto hostAcc = pMap.get_access<sycl_acc_rw, sycl_acc_host>(myPtr);
+      get_host_ptr_as<float>(hostAcc)[10] = 2.0f;
+    }
+
+    cl::sycl::queue q;
+    SYCLprefetch(myPtr, 100 * sizeof(float), q, pMap);
+    q.submit([&](cl::sycl::handler &h) {
+      auto acc = pMap.get_access<sycl_acc_rw>(myPtr, h);
+      h.single_task<class prefetch_kernel>([=]() {
+        get_device_ptr_as<float>(acc)[0] = get_device_ptr_as<float>(acc)[10];
+      });
+    });
+
+    {
+      auto hostAcc = pMap.get_access<sycl_acc_rw, sycl_acc_host>(myPtr);
+      ASSERT_EQ(get_host_ptr_as<float>(hostAcc)[0], 2.0f);
+    }
+
+    // Ranges outside of the allocation cannot be prefetched
+    ASSERT_THROW(SYCLprefetch(myPtr, 200 * sizeof(float), q, pMap),
+                 std::out_of_range);
+    SYCLfree(myPtr, pMap);
+    ASSERT_EQ(pMap.count(), 0u);
+  }
+}
+
+TEST(accessor, hints) {
+  PointerMapper pMap;
+  {
+    void *ptrA = SYCLmalloc(100, pMap);
+    void *ptrB = SYCLmalloc(100, pMap, alloc_hint::host_readback);
+    ASSERT_EQ(pMap.get_node(ptrA)->second.m_hint, alloc_hint::device_only);
+    ASSERT_EQ(pMap.get_node(ptrB)->second.m_hint, alloc_hint::host_readback);
+
+    // A recovered node takes the hint of the new allocation
+    SYCLfree(ptrA, pMap);
+    void *ptrC = SYCLmalloc(50, pMap, alloc_hint::read_mostly);
+    ASSERT_EQ(ptrA, ptrC);
+    ASSERT_EQ(pMap.get_node(ptrC)->second.m_hint, alloc_hint::read_mostly);
+
+    SYCLfree(ptrB, pMap);
+    SYCLfree(ptrC, pMap);
+    ASSERT_EQ(pMap.count(), 0u);
+  }
+}
+
+TEST(accessor, vec_view) {
+  PointerMapper pMap;
+  {
+    const size_t SIZE = 10;  // Two float4 and a tail of two floats
+    void *myPtr = SYCLmalloc(SIZE * sizeof(float), pMap);
+    {
+      auto hostAcc = pMap.get_access<sycl_acc_mode::discard_write,
+                                    sycl_acc_host>(myPtr);
+      float *fPtr = get_host_ptr_as<float>(hostAcc);
+      for (unsigned i = 0; i < SIZE; i++) {
+        fPtr[i] = i;
+      }
+    }
+
+    cl::sycl::queue q;
+    q.submit([&](cl::sycl::handler &h) {
+      auto accB = pMap.get_access<sycl_acc_rw>(myPtr, h);
+      h.single_task<class vec_view_test>([=]() {
+        auto view = get_device_vec_view<float, 4>(accB);
+        for (size_t i = 0; i < view.size(); i++) {
+          auto v = view.load(i);
+          view.store(i, v + v);
+        }
+        auto t = view.load_tail();
+        view.store_tail(t + t);
+      });
+    });
+
+    {
+      auto hostAcc = pMap.get_access<sycl_acc_mode::read, sycl_acc_host>(myPtr);
+      auto view = get_host_vec_view<float, 4>(hostAcc);
+      ASSERT_EQ(view.size(), 2u);
+      ASSERT_EQ(view.tail_size(), 2u);
+      float *fPtr = get_host_ptr_as<float>(hostAcc);
+      for (unsigned i = 0; i < SIZE; i++) {
+        ASSERT_EQ(fPtr[i], 2.0f * i);
+      }
+      // The tail is padded with zeros
+      float tail[4];
+      view.load_tail().store(
+          0, cl::sycl::multi_ptr<float, cl::sycl::access::address_space::
+                                             private_space>(tail));
+      ASSERT_EQ(tail[1], 18.0f);
+      ASSERT_EQ(tail[2], 0.0f);
+      ASSERT_EQ(tail[3], 0.0f);
+    }
+    SYCLfree(myPtr, pMap);
+  }
+}
+
+TEST(accessor, unaligned_vec_view) {
+  PointerMapper pMap;
+  {
+    const size_t SIZE = 18;
+    void *myPtr = SYCLmalloc(SIZE * sizeof(float), pMap);
+    {
+      auto hostAcc = pMap.get_access<sycl_acc_rw, sycl_acc_host>(myPtr);
+      float *fPtr = get_host_ptr_as<float>(hostAcc);
+      for (unsigned i = 0; i < SIZE; i++) {
+        fPtr[i] = i;
+      }
+
+      // Skip the first float, or the first two if the second one is
+      // aligned to the size of the vectors, so the view is never aligned
+      const size_t vecBytes = 8 * sizeof(float);
+      size_t first = 1;
+      if (reinterpret_cast<uintptr_t>(fPtr + first) % vecBytes == 0) {
+        first = 2;
+      }
+      auto view = get_host_vec_view<float, 8>(hostAcc, first * sizeof(float));
+      ASSERT_FALSE(view.is_aligned());
+      ASSERT_EQ(view.size(), 2u);
+      ASSERT_EQ(view.tail_size(), SIZE - first - 16);
+      auto v = view.load(1);
+      view.store(0, v);
+      for (unsigned i = 0; i < 8; i++) {
+        ASSERT_EQ(fPtr[first + i], float(first + 8 + i));
+      }
+      ASSERT_EQ(fPtr[first - 1], float(first - 1));
+
+      // Offsets past the end of the accessor are rejected
+      const size_t numBytes = SIZE * sizeof(float);
+      auto empty = get_host_vec_view<float, 8>(hostAcc, numBytes);
+      ASSERT_EQ(empty.size(), 0u);
+      ASSERT_EQ(empty.tail_size(), 0u);
+      auto pastEnd = [&]() {
+        get_host_vec_view<float, 8>(hostAcc, numBytes + 1);
+      };
+      ASSERT_THROW(pastEnd(), std::out_of_range);
+    }
+    SYCLfree(myPtr, pMap);
+  }
+}
@@ -0,0 +1,173 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  chunk.cc
+ *
+ *  Description:
+ *   Tests for allocations split in several buffers
+ *
+ **************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <CL/sycl.hpp>
+#include <iostream>
+
+#include "pointer_alias.hpp"
+#include "virtual_ptr.hpp"
+
+using sycl_acc_target = cl::sycl::access::target;
+const sycl_acc_target sycl_acc_host = sycl_acc_target::host_buffer;
+
+using sycl_acc_mode = cl::sycl::access::mode;
+const sycl_acc_mode sycl_acc_rw = sycl_acc_mode::read_write;
+
+using namespace cl::sycl::codeplay;
+
+const size_t chunkSize = 256;
+
+TEST(chunk, single_chunk) {
+  PointerMapper pMap(chunkSize);
+  {
+    ASSERT_EQ(pMap.get_max_chunk_size(), chunkSize);
+    void *ptr = SYCLmalloc(chunkSize, pMap);
+    ASSERT_NE(ptr, nullptr);
+    ASSERT_EQ(pMap.count(), 1u);
+    ASSERT_EQ(pMap.get_node(ptr)->second.m_size, chunkSize);
+    ASSERT_FALSE(pMap.get_node(ptr)->second.m_continuation);
+    SYCLfree(ptr, pMap);
+    ASSERT_EQ(pMap.count(), 0u);
+  }
+}
+
+TEST(chunk, resolve_offsets) {
+  PointerMapper pMap(chunkSize);
+  {
+    const size_t size = 3 * chunkSize + 100;
+    auto ptr = static_cast<uint8_t *>(SYCLmalloc(size, pMap));
+    ASSERT_NE(ptr, nullptr);
+    // A chunked allocation counts as a single pointer
+    ASSERT_EQ(pMap.count(), 1u);
+
+    // Each chunk is a different node of the map
+    ASSERT_EQ(pMap.get_node(ptr)->second.m_size, chunkSize);
+    ASSERT_NE(pMap.get_node(ptr), pMap.get_node(ptr + chunkSize));
+    ASSERT_TRUE(pMap.get_node(ptr + chunkSize)->second.m_continuation);
+    ASSERT_EQ(pMap.get_node(ptr + 3 * chunkSize)->second.m_size, 100u);
+
+    // Offsets are relative to the chunk
+    ASSERT_EQ(pMap.get_offset(ptr + 10), 10);
+    ASSERT_EQ(pMap.get_offset(ptr + chunkSize + 10), 10);
+    ASSERT_EQ(pMap.get_offset(ptr + 3 * chunkSize + 99), 99);
+
+    SYCLfree(ptr, pMap);
+    ASSERT_EQ(pMap.count(), 0u);
+  }
+}
+
+TEST(chunk, for_each_chunk) {
+  PointerMapper pMap(chunkSize);
+  {
+    const size_t numElems = 200;
+    const size_t size = numElems * sizeof(int);
+    auto ptr = static_cast<int *>(SYCLmalloc(size, pMap));
+    ASSERT_EQ(pMap.count(), 1u);
+
+    // Range starting in the middle of the first chunk
+    auto start = ptr + 10;
+    const size_t rangeSize = size - 10 * sizeof(int);
+    size_t numChunks = 0;
+    size_t total = 0;
+    pMap.for_each_chunk(start, rangeSize,
+                        [&](PointerMapper::buffer_t, size_t offset,
+                            size_t bytes, size_t rangeOffset) {
+                          ASSERT_EQ(rangeOffset, total);
+                          if (numChunks == 0) {
+                            ASSERT_EQ(offset, 10 * sizeof(int));
+                          } else {
+                            ASSERT_EQ(offset, 0u);
+                          }
+                          total += bytes;
+                          numChunks++;
+                        });
+    ASSERT_EQ(total, rangeSize);
+    ASSERT_EQ(numChunks, (size + chunkSize - 1) / chunkSize);
+
+    // The range cannot go past the end of the allocation
+    auto noop = [](PointerMapper::buffer_t, size_t, size_t, size_t) {};
+    ASSERT_THROW(pMap.for_each_chunk(start, size, noop), std::out_of_range);
+
+    SYCLfree(ptr, pMap);
+    ASSERT_EQ(pMap.count(), 0u);
+  }
+}
+
+TEST(chunk, write_all_chunks) {
+  PointerMapper pMap(chunkSize);
+  {
+    const size_t size = 4 * chunkSize;
+    auto ptr = static_cast<uint8_t *>(SYCLmalloc(size, pMap));
+    cl::sycl::queue q;
+    pMap.for_each_chunk(ptr, size, [&](PointerMapper::buffer_t, size_t offset,
+                                       size_t, size_t rangeOffset) {
+      int value = static_cast<int>(rangeOffset / chunkSize) + 1;
+      q.submit([&](cl::sycl::handler &h) {
+        auto acc = pMap.get_access<sycl_acc_rw>(ptr + rangeOffset, h);
+        h.single_task<class chunk_write>([=]() {
+          cl::sycl::codeplay::get_device_ptr_as<int>(acc)[offset] = value;
+        });
+      });
+    });
+    q.wait_and_throw();
+
+    for (size_t i = 0; i < size / chunkSize; i++) {
+      auto hostAcc =
+          pMap.get_access<sycl_acc_rw, sycl_acc_host>(ptr + i * chunkSize);
+      ASSERT_EQ(cl::sycl::codeplay::get_host_ptr_as<int>(hostAcc)[0], i + 1);
+    }
+
+    SYCLfree(ptr, pMap);
+    ASSERT_EQ(pMap.count(), 0u);
+  }
+}
+
+TEST(chunk, reuse_chunked_space) {
+  PointerMapper pMap(chunkSize);
+  {
+    auto first = static_cast<uint8_t *>(SYCLmalloc(10, pMap));
+    auto large = static_cast<uint8_t *>(SYCLmalloc(3 * chunkSize, pMap));
+    auto last = static_cast<uint8_t *>(SYCLmalloc(10, pMap));
+    ASSERT_EQ(pMap.count(), 3u);
+    ASSERT_EQ(large, first + 10);
+    ASSERT_EQ(last, large + 3 * chunkSize);
+
+    // Freeing the large allocation releases all the chunks as a
+    // single free node
+    SYCLfree(large, pMap);
+    ASSERT_EQ(pMap.count(), 2u);
+    ASSERT_TRUE(pMap.get_node(large)->second.m_free);
+    ASSERT_EQ(pMap.get_node(large)->second.m_size, 3 * chunkSize);
+
+    // The space can be reused by a smaller allocation
+    auto reused = static_cast<uint8_t *>(SYCLmalloc(chunkSize, pMap));
+    ASSERT_EQ(reused, large);
+    ASSERT_EQ(pMap.count(), 3u);
+  }
+}
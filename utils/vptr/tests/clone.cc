@@ -0,0 +1,189 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  clone.cc
+ *
+ *  Description:
+ *   Tests for copy-on-write clones of virtual pointers
+ *
+ **************************************************************************/
+
+#include "gtest/gtest.h"
+
+#include <CL/sycl.hpp>
+#include <iostream>
+
+#include "pointer_alias.hpp"
+#include "virtual_ptr.hpp"
+
+using sycl_acc_target = cl::sycl::access::target;
+const sycl_acc_target sycl_acc_host = sycl_acc_target::host_buffer;
+
+using sycl_acc_mode = cl::sycl::access::mode;
+const sycl_acc_mode sycl_acc_r = sycl_acc_mode::read;
+const sycl_acc_mode sycl_acc_rw = sycl_acc_mode::read_write;
+
+using namespace cl::sycl::codeplay;
+
+/* Writes the given value in the first float of the pointer */
+void write_value(PointerMapper &pMap, void *ptr, float value) {
+  cl::sycl::queue q;
+  pMap.detach_shared(ptr);
+  q.submit([&](cl::sycl::handler &h) {
+    auto acc = pMap.get_access<sycl_acc_rw>(ptr, h);
+    h.single_task<class clone_write>(
+        [=]() { get_device_ptr_as<float>(acc)[0] = value; });
+  });
+  q.wait_and_throw();
+}
+
+/* Reads the first float of the pointer */
+float read_value(PointerMapper &pMap, void *ptr) {
+  auto hostAcc = pMap.get_access<sycl_acc_r, sycl_acc_host>(ptr);
+  return get_host_ptr_as<float>(hostAcc)[0];
+}
+
+TEST(clone, shared_until_written) {
+  PointerMapper pMap;
+  cl::sycl::queue q;
+  {
+    void *original = SYCLmalloc(100 * sizeof(float), pMap);
+    write_value(pMap, original, 1.0f);
+    ASSERT_FALSE(pMap.is_shared(original));
+
+    void *clone = SYCLclone(original, pMap, q);
+    ASSERT_NE(clone, original);
+    ASSERT_EQ(pMap.count(), 2u);
+    ASSERT_TRUE(pMap.is_shared(original));
+    ASSERT_TRUE(pMap.is_shared(clone));
+
+    // Reading does not copy the data
+    ASSERT_EQ(read_value(pMap, clone), 1.0f);
+    ASSERT_TRUE(pMap.is_shared(clone));
+
+    // Writing the clone gives it its own buffer
+    write_value(pMap, clone, 2.0f);
+    ASSERT_FALSE(pMap.is_shared(clone));
+    ASSERT_FALSE(pMap.is_shared(original));
+    ASSERT_EQ(read_value(pMap, original), 1.0f);
+    ASSERT_EQ(read_value(pMap, clone), 2.0f);
+
+    SYCLfree(original, pMap);
+    SYCLfree(clone, pMap);
+    ASSERT_EQ(pMap.count(), 0u);
+  }
+}
+
+TEST(clone, write_original) {
+  PointerMapper pMap;
+  cl::sycl::queue q;
+  {
+    void *original = SYCLmalloc(100 * sizeof(float), pMap);
+    write_value(pMap, original, 1.0f);
+    void *clone = SYCLclone(original, pMap, q);
+
+    write_value(pMap, original, 3.0f);
+    ASSERT_EQ(read_value(pMap, original), 3.0f);
+    ASSERT_EQ(read_value(pMap, clone), 1.0f);
+  }
+}
+
+TEST(clone, free_original) {
+  PointerMapper pMap;
+  cl::sycl::queue q;
+  {
+    void *original = SYCLmalloc(100 * sizeof(float), pMap);
+    write_value(pMap, original, 1.0f);
+    void *cloneA = SYCLclone(original, pMap, q);
+    void *cloneB = SYCLclone(original, pMap, q);
+    ASSERT_EQ(pMap.count(), 3u);
+
+    SYCLfree(original, pMap);
+    ASSERT_TRUE(pMap.is_shared(cloneA));
+    SYCLfree(cloneB, pMap);
+    // The remaining clone is the only user of the buffer
+    ASSERT_FALSE(pMap.is_shared(cloneA));
+    ASSERT_EQ(read_value(pMap, cloneA), 1.0f);
+  }
+}
+
+TEST(clone, chunked) {
+  const size_t chunkSize = 256;
+  PointerMapper pMap(chunkSize);
+  cl::sycl::queue q;
+  {
+    auto original = static_cast<uint8_t *>(SYCLmalloc(3 * chunkSize, pMap));
+    write_value(pMap, original + chunkSize, 1.0f);
+    auto clone = static_cast<uint8_t *>(SYCLclone(original, pMap, q));
+    ASSERT_EQ(pMap.count(), 2u);
+
+    // Only the written chunk is copied
+    write_value(pMap, clone + chunkSize, 2.0f);
+    ASSERT_TRUE(pMap.is_shared(clone));
+    ASSERT_FALSE(pMap.is_shared(clone + chunkSize));
+    ASSERT_TRUE(pMap.is_shared(clone + 2 * chunkSize));
+    ASSERT_EQ(read_value(pMap, original + chunkSize), 1.0f);
+    ASSERT_EQ(read_value(pMap, clone + chunkSize), 2.0f);
+
+    // Clones can only be created from the start of an allocation
+    ASSERT_THROW(SYCLclone(original + 1, pMap, q), std::out_of_range);
+  }
+}
+
+TEST(clone, write_in_command_group) {
+  PointerMapper pMap;
+  cl::sycl::queue q;
+  {
+    void *original = SYCLmalloc(100 * sizeof(float), pMap);
+    write_value(pMap, original, 1.0f);
+    void *clone = SYCLclone(original, pMap, q);
+
+    // The copy cannot be submitted from inside the command group
+    ASSERT_THROW(q.submit([&](cl::sycl::handler &h) {
+      pMap.get_access<sycl_acc_rw>(clone, h);
+    }),
+                 std::logic_error);
+    ASSERT_TRUE(pMap.is_shared(clone));
+
+    // Discarding the contents needs no copy
+    q.submit([&](cl::sycl::handler &h) {
+      pMap.get_access<cl::sycl::access::mode::discard_write>(clone, h);
+    });
+    ASSERT_FALSE(pMap.is_shared(clone));
+    ASSERT_EQ(read_value(pMap, original), 1.0f);
+  }
+}
+
+TEST(clone, keeps_allocator_and_hint) {
+  PointerMapper pMap;
+  cl::sycl::queue q;
+  {
+    void *original =
+        SYCLmalloc(100 * sizeof(float), pMap, alloc_hint::host_readback);
+    void *clone = SYCLclone(original, pMap, q);
+    auto makeBuffer = pMap.get_node(original)->second.m_makeBuffer;
+    ASSERT_EQ(pMap.get_node(clone)->second.m_makeBuffer, makeBuffer);
+
+    pMap.detach_shared(clone);
+    ASSERT_FALSE(pMap.is_shared(clone));
+    ASSERT_EQ(pMap.get_node(clone)->second.m_makeBuffer, makeBuffer);
+    ASSERT_EQ(pMap.get_node(clone)->second.m_hint, alloc_hint::host_readback);
+  }
+}
@@ -0,0 +1,119 @@
+/***************************************************************************
+ *
+ *  Copyright (C) 2016 Codeplay Software Limited
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  For your convenience, a copy of the License has been included in this
+ *  repository.
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ *
+ *  Codeplay's ComputeCpp SDK
+ *
+ *  lookup_bench.cc
+ *
+ *  Description:
+ *   Compares the cost of resolving virtual pointers with the flat index
+ *   of the pointer mapper against the previous std::map index.
+ *   Usage: lookup_bench [number of allocations] [number of lookups]
+ *
+ **************************************************************************/
+
+#include <CL/sycl.hpp>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "virtual_ptr.hpp"
+
+using namespace cl::sycl::codeplay;
+
+using virtual_pointer_t = PointerMapper::virtual_pointer_t;
+using node_t = PointerMapper::pMapNode_t;
+
+/* Previous index of the pointer mapper, with the same lookup
+ * algorithm as PointerMapper::get_node */
+using std_map_t = std::map<virtual_pointer_t, node_t>;
+
+std_map_t::iterator get_node(std_map_t &pMap, const virtual_pointer_t ptr) {
+  auto node = pMap.lower_bound(ptr);
+  if (node == std::end(pMap) || node->first != ptr) {
+    --node;
+  }
+  return node;
+}
+
+/* Runs the given lookup function for all the pointers and returns
+ * the average time per lookup in nanoseconds */
+template <typename Func>
+double time_lookups(const std::vector<virtual_pointer_t> &ptrs, Func f) {
+  size_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (auto ptr : ptrs) {
+    checksum += f(ptr);
+  }
+  auto end = std::chrono::steady_clock::now();
+  // Prevent the compiler from removing the lookups
+  if (checksum == 0) {
+    std::cout << " Empty checksum " << std::endl;
+  }
+  std::chrono::duration<double, std::nano> time = end - start;
+  return time.count() / ptrs.size();
+}
+
+int main(int argc, char *argv[]) {
+  size_t numAllocations = (argc > 1) ? std::stoul(argv[1]) : (1 << 17);
+  size_t numLookups = (argc > 2) ? std::stoul(argv[2]) : (1 << 22);
+
+  std::default_random_engine e1(42);
+  std::uniform_int_distribution<size_t> sizeDist(1, 4096);
+
+  PointerMapper pMap;
+  std_map_t stdMap;
+  std::vector<virtual_pointer_t> bases;
+  std::vector<size_t> sizes;
+  for (size_t i = 0; i < numAllocations; i++) {
+    auto size = sizeDist(e1);
+    auto ptr = virtual_pointer_t(SYCLmalloc(size, pMap));
+    stdMap.emplace(ptr, pMap.get_node(ptr)->second);
+    bases.push_back(ptr);
+    sizes.push_back(size);
+  }
+
+  // Random pointers inside the allocations
+  std::uniform_int_distribution<size_t> allocDist(0, numAllocations - 1);
+  std::vector<virtual_pointer_t> ptrs;
+  ptrs.reserve(numLookups);
+  for (size_t i = 0; i < numLookups; i++) {
+    auto alloc = allocDist(e1);
+    std::uniform_int_distribution<size_t> offsetDist(0, sizes[alloc] - 1);
+    ptrs.push_back(bases[alloc] + offsetDist(e1));
+  }
+
+  auto stdMapTime = time_lookups(ptrs, [&](virtual_pointer_t ptr) {
+    return get_node(stdMap, ptr)->second.m_size;
+  });
+  auto flatTime = time_lookups(ptrs, [&](virtual_pointer_t ptr) {
+    return pMap.get_node(ptr)->second.m_size;
+  });
+
+  std::cout << " Allocations: " << numAllocations << std::endl;
+  std::cout << " Lookups: " << numLookups << std::endl;
+  std::cout << " std::map index: " << stdMapTime << " ns/lookup" << std::endl;
+  std::cout << " Flat index: " << flatTime << " ns/lookup" << std::endl;
+  std::cout << " Speedup: " << stdMapTime / flatTime << std::endl;
+
+  return 0;
+}
@@ -29,6 +29,8 @@
 
 #include <CL/sycl.hpp>
 #include <iostream>
+#include <map>
+#include <random>
 
 #include "pointer_alias.hpp"
 #include "virtual_ptr.hpp"
@@ -213,3 +215,42 @@ TEST(space, fragmentation) {
     ASSERT_EQ(freeSize, pMap.get_node(ptrFree)->second.m_size);
   }
 }
+
+TEST(space, flat_map_matches_std_map) {
+  // Random insertions and removals keep the flat index
+  // in the same order as a std::map
+  using key_t = PointerMapper::virtual_pointer_t;
+  sorted_flat_map<key_t, int> flatMap;
+  std::map<key_t, int> refMap;
+  std::default_random_engine e1(42);
+  std::uniform_int_distribution<int> keyDist(1, n);
+  for (int i = 0; i < n; i++) {
+    key_t key{static_cast<PointerMapper::base_ptr_t>(keyDist(e1))};
+    if (i % 3 == 2) {
+      auto it = flatMap.find(key);
+      ASSERT_EQ(it == flatMap.end(), refMap.find(key) == refMap.end());
+      if (it != flatMap.end()) {
+        flatMap.erase(it);
+        refMap.erase(key);
+      }
+    } else {
+      ASSERT_EQ(flatMap.emplace(key, i).second,
+                refMap.emplace(key, i).second);
+    }
+    ASSERT_EQ(flatMap.size(), refMap.size());
+  }
+  auto refIt = refMap.begin();
+  for (auto it = flatMap.begin(); it != flatMap.end(); ++it, ++refIt) {
+    ASSERT_EQ(it->first, refIt->first);
+    ASSERT_EQ(it->second, refIt->second);
+  }
+  for (int i = 1; i <= n; i++) {
+    key_t key{static_cast<PointerMapper::base_ptr_t>(i)};
+    auto refLower = refMap.lower_bound(key);
+    auto lower = flatMap.lower_bound(key);
+    ASSERT_EQ(lower == flatMap.end(), refLower == refMap.end());
+    if (refLower != refMap.end()) {
+      ASSERT_EQ(lower->first, refLower->first);
+    }
+  }
+}